@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "aggr.h"
+#include "simd.h"
+#include "tpool.h"
+
+#define AGGR_PARALLEL_MIN (1 << 18)
+
+struct aggr_task {
+    enum aggr agg;              // MIN, MAX or SUM
+    const void *vals;
+    size_t n;
+    bool wide;
+    __int128 result;
+};
+
+static
+void aggr_part(void *arg) {
+    struct aggr_task *t = arg;
+    const int *ints = t->vals;
+    const long int *longs = t->vals;
+    switch(t->agg) {
+	case MIN:
+	    t->result = (t->wide) ? simd_min_long(longs, t->n) : simd_min(ints, t->n);
+	    break;
+	case MAX:
+	    t->result = (t->wide) ? simd_max_long(longs, t->n) : simd_max(ints, t->n);
+	    break;
+	case SUM:
+	    t->result = (t->wide) ? simd_sum_long(longs, t->n) : simd_sum(ints, t->n);
+	    break;
+	case AVG: case COUNT:
+	    assert(false);
+    }
+}
+
+/* one slice per thread of the execution pool and one for the caller */
+static
+__int128 aggr_run(enum aggr agg, const void *vals, size_t n, enum result_type type) {
+    assert(type == VECTOR || type == LONG_VECTOR);
+    if (n == 0) return 0;
+    bool wide = type == LONG_VECTOR;
+    size_t width = (wide) ? sizeof(long int) : sizeof(int);
+
+    struct tpool *tp = exec_pool();
+    size_t nt = tpool_tasks(tp, n, AGGR_PARALLEL_MIN);
+    if (nt == 1) {
+	struct aggr_task t = { agg, vals, n, wide, 0 };
+	aggr_part(&t);
+	return t.result;
+    }
+
+    struct aggr_task *ts = malloc(nt * sizeof *ts);
+    assert(ts);
+    for (size_t j = 0; j < nt; j++) {
+	size_t len, off = tpool_slice(n, nt, j, &len);
+	ts[j] = (struct aggr_task) { agg, (const char *) vals + off * width, len, wide, 0 };
+    }
+    // a slice past the end computes nothing; drop it
+    while (nt > 1 && ts[nt - 1].n == 0) nt--;
+
+    tpool_run(tp, aggr_part, ts, nt, sizeof *ts);
+
+    __int128 r = ts[0].result;
+    for (size_t j = 1; j < nt; j++) {
+	__int128 v = ts[j].result;
+	if (agg == MIN) r = (v < r) ? v : r;
+	else if (agg == MAX) r = (v > r) ? v : r;
+	else r += v;
+    }
+    free(ts);
+    return r;
+}
+
+long int aggr_min(const void *vals, size_t n, enum result_type type) {
+    return aggr_run(MIN, vals, n, type);
+}
+
+long int aggr_max(const void *vals, size_t n, enum result_type type) {
+    return aggr_run(MAX, vals, n, type);
+}
+
+__int128 aggr_sum(const void *vals, size_t n, enum result_type type) {
+    return aggr_run(SUM, vals, n, type);
+}
@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "bitmap.h"
+
+/* the words are left uninitialized: scans write every one of them */
+uint64_t *bitmap_alloc(size_t nbits) {
+    uint64_t *bits = malloc(BITMAP_WORDS(nbits) * sizeof *bits);
+    assert(bits || nbits == 0);
+    return bits;
+}
+
+bool bitmap_isset(const uint64_t *bits, size_t j) {
+    return (bits[j / 64] >> (j % 64)) & 1;
+}
+
+size_t bitmap_count(const uint64_t *bits, size_t nbits) {
+    size_t count = 0;
+    for (size_t w = 0; w < BITMAP_WORDS(nbits); w++)
+        count += __builtin_popcountll(bits[w]);
+    return count;
+}
+
+/* sets bits [0, nbits), writing every word, and returns nbits */
+size_t bitmap_fill(uint64_t *bits, size_t nbits) {
+    size_t full = nbits / 64;
+    memset(bits, 0xff, full * sizeof *bits);
+    if (nbits % 64) bits[full] = (UINT64_C(1) << (nbits % 64)) - 1;
+    return nbits;
+}
+
+/* writes the set positions in increasing order, returns how many */
+size_t bitmap_positions(int *out, const uint64_t *bits, size_t nbits) {
+    size_t k = 0;
+    for (size_t w = 0; w < BITMAP_WORDS(nbits); w++) {
+        for (uint64_t word = bits[w]; word; word &= word - 1)
+            out[k++] = w * 64 + __builtin_ctzll(word);
+    }
+    return k;
+}
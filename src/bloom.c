@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "bloom.h"
+
+/*
+ * The top bits of the hash pick a block of the zone's filter and six bits
+ * each pick the bit set in every word of the block, so a probe reads a
+ * single cache line.
+ */
+static inline
+uint64_t *bloom_block(uint64_t *filter, uint64_t h) {
+    return filter + (h >> 58) % (BLOOM_ZONE_WORDS / BLOOM_BLOCK_WORDS) * BLOOM_BLOCK_WORDS;
+}
+
+static inline
+void bloom_add(uint64_t *filter, int value) {
+    uint64_t h = bloom_hash(value);
+    uint64_t *block = bloom_block(filter, h);
+    for (int j = 0; j < BLOOM_BLOCK_WORDS; j++)
+	block[j] |= UINT64_C(1) << ((h >> (6 * j)) & 63);
+}
+
+bool bloom_test(const struct bloom *b, size_t zone, int value) {
+    uint64_t h = bloom_hash(value);
+    const uint64_t *block = bloom_block(b->words + zone * BLOOM_ZONE_WORDS, h);
+    for (int j = 0; j < BLOOM_BLOCK_WORDS; j++)
+	if (!(block[j] >> ((h >> (6 * j)) & 63) & 1)) return false;
+    return true;
+}
+
+void bloom_free(struct bloom *b) {
+    free(b->words);
+    b->nzones = b->capacity = 0;
+    b->words = NULL;
+}
+
+static
+void bloom_reserve(struct bloom *b, size_t nzones) {
+    if (nzones <= b->capacity && b->words) return;
+    size_t capacity = (b->capacity) ? b->capacity : 8;
+    while (capacity < nzones) capacity *= 2;
+    b->words = realloc(b->words, capacity * BLOOM_ZONE_WORDS * sizeof *b->words);
+    assert(b->words);
+    b->capacity = capacity;
+}
+
+/* refills the filters of vals[first * ZONE_SIZE, sz) */
+static
+void bloom_rebuild(struct bloom *b, const int *vals, size_t sz, size_t first) {
+    b->nzones = (sz + ZONE_SIZE - 1) / ZONE_SIZE;
+    bloom_reserve(b, b->nzones);
+    for (size_t z = first; z < b->nzones; z++) {
+	uint64_t *filter = b->words + z * BLOOM_ZONE_WORDS;
+	size_t end = (z + 1) * ZONE_SIZE < sz ? (z + 1) * ZONE_SIZE : sz;
+	memset(filter, 0, BLOOM_ZONE_WORDS * sizeof *filter);
+	for (size_t j = z * ZONE_SIZE; j < end; j++)
+	    bloom_add(filter, vals[j]);
+    }
+}
+
+void bloom_build(struct bloom *b, const int *vals, size_t sz) {
+    bloom_rebuild(b, vals, sz, 0);
+}
+
+/* same as zonemap_insert(); a column without filters stays without */
+void bloom_insert(struct bloom *b, const int *vals, size_t sz, size_t pos) {
+    if (b->words == NULL) return;
+
+    size_t z = pos / ZONE_SIZE;
+    if (pos + 1 < sz || z > b->nzones) {
+	bloom_rebuild(b, vals, sz, (z < b->nzones) ? z : b->nzones);
+	return;
+    }
+
+    if (z == b->nzones) {
+	bloom_reserve(b, z + 1);
+	memset(b->words + z * BLOOM_ZONE_WORDS, 0, BLOOM_ZONE_WORDS * sizeof *b->words);
+	b->nzones++;
+    }
+    bloom_add(b->words + z * BLOOM_ZONE_WORDS, vals[pos]);
+}
+
+/* the old value cannot be removed and may report false positives */
+void bloom_update(struct bloom *b, size_t pos, int value) {
+    if (b->words == NULL) return;
+    bloom_add(b->words + pos / ZONE_SIZE * BLOOM_ZONE_WORDS, value);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// A filter of a whole set of values, in blocks of one cache line like those
+// of a zone; a second mix of the hash picks the block, so any number of
+// blocks can be addressed.
+
+/* about 16 bits per value, half of them set */
+#define BLOOM_SET_VALUES_PER_BLOCK 32
+
+void bloom_set_build(struct bloom_set *s, const int *vals, size_t n) {
+    int bits = 0;
+    while (((size_t) 1 << bits) * BLOOM_SET_VALUES_PER_BLOCK < n) bits++;
+    s->bits = bits;
+    s->words = calloc((size_t) BLOOM_BLOCK_WORDS << bits, sizeof *s->words);
+    assert(s->words);
+    for (size_t j = 0; j < n; j++) {
+	uint64_t h = bloom_hash(vals[j]);
+	uint64_t *block = s->words + bloom_set_block(s, h) * BLOOM_BLOCK_WORDS;
+	for (int k = 0; k < BLOOM_BLOCK_WORDS; k++)
+	    block[k] |= UINT64_C(1) << ((h >> (6 * k)) & 63);
+    }
+}
+
+void bloom_set_free(struct bloom_set *s) {
+    free(s->words);
+    s->words = NULL;
+}
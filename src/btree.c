@@ -28,6 +28,7 @@ enum btnode_type { INTERNAL = 1, LEAF };
 struct btnode {
     enum btnode_type ntype;
     short ksz;
+    struct btstats stats;   // of the keys in the subtree
     int keys[MAXKEYS];
     bset idref[FANOUTSET];  // only used in leafs to distinguish between id and ids
     union value {
@@ -49,6 +50,7 @@ struct btnode *allocate_btnode(enum btnode_type type) {
     struct btnode *node = malloc(sizeof *node);
     node->ntype = type;
     node->ksz = 0;
+    node->stats = (struct btstats) { 0, 0, INT_MAX, INT_MIN };
     if (type == LEAF) {
 	memset(node->idref, 0, sizeof node->idref);
 	node->values[FANOUT-1].child = NULL;
@@ -164,7 +166,9 @@ void btree_free(struct btree *bt) {
 static inline
 struct vec *get_vector(struct btnode *node, int i) {
     if (bset_isset(node->idref, i)) {
-	return node->values[i].ids;
+	struct vec *v = vector_create(node->values[i].ids->sz);
+	vector_append(v, node->values[i].ids);
+	return v;
     } else {
 	struct vec *v = vector_create(1);
 	vector_push(v, node->values[i].id);
@@ -198,7 +202,17 @@ int btree_max(struct btree *bt) {
     while (node->ntype == INTERNAL)
 	node = node->values[node->ksz].child;
 
-    return node->keys[node->ksz - 1];
+    return (node->ksz) ? node->keys[node->ksz - 1] : INT_MAX;
+}
+
+int btree_min(struct btree *bt) {
+    if (bt == NULL) return INT_MIN;
+
+    struct btnode *node = bt->root;
+    while (node->ntype == INTERNAL)
+	node = node->values[0].child;
+
+    return (node->ksz) ? node->keys[0] : INT_MIN;
 }
 
 static
@@ -208,7 +222,7 @@ struct btnode *btnode_search(struct btnode *node, int k) {
     switch (node->ntype) {
         case LEAF: return node;
         case INTERNAL:
-            while (i < node->ksz && node->keys[i] < k) i++;
+            while (i < node->ksz && node->keys[i] <= k) i++;
             return btnode_search(node->values[i].child, k);
     }
 }
@@ -224,6 +238,39 @@ struct vec *btree_search(struct btree *bt, int k) {
     return result;
 }
 
+/*
+ * leaves[j] = the leaf that would hold keys[j], for |n| keys. The keys
+ * descend together, a level at a time, and each step prefetches the node
+ * it goes to next, so the misses of a batch overlap. All leaves are at the
+ * same depth.
+ */
+void btree_leaves(struct btree *bt, const int *keys, size_t n, struct btnode **leaves) {
+    for (size_t j = 0; j < n; j++) leaves[j] = bt->root;
+    while (n && leaves[0]->ntype == INTERNAL) {
+	for (size_t j = 0; j < n; j++) {
+	    struct btnode *node = leaves[j];
+	    int i = 0;
+	    while (i < node->ksz && node->keys[i] <= keys[j]) i++;
+	    leaves[j] = node->values[i].child;
+	    __builtin_prefetch(leaves[j]);
+	    __builtin_prefetch((char *) leaves[j] + 64);
+	    __builtin_prefetch((char *) leaves[j] + 128);
+	}
+    }
+}
+
+/* the number of ids of |k| in |leaf|, in |*ids|, which are not copied */
+size_t btree_leaf_ids(struct btnode *leaf, int k, const int **ids) {
+    int i = indexOf(k, leaf->keys, leaf->ksz);
+    if (i == -1) return 0;
+    if (bset_isset(leaf->idref, i)) {
+	*ids = leaf->values[i].ids->vals;
+	return leaf->values[i].ids->sz;
+    }
+    *ids = &leaf->values[i].id;
+    return 1;
+}
+
 static inline
 void collect_ids(struct btnode *leaf, int lo, int hi, struct vec *v) {
     int i = 0;
@@ -252,6 +299,76 @@ struct vec *btree_rsearch(struct btree *bt, int lo, int hi) {
     return v;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Every node keeps the count, sum, min and max of the keys below it, each
+// key counted once per id. A range aggregate takes the stats of the
+// subtrees that lie inside the range whole and reads keys only in the two
+// leaves at its ends.
+
+static inline
+long int entry_count(struct btnode *leaf, int i) {
+    return (bset_isset(leaf->idref, i)) ? (long int) leaf->values[i].ids->sz : 1;
+}
+
+static inline
+void stats_add(struct btstats *s, int k, long int count) {
+    s->count += count;
+    s->sum += k * count;
+    s->min = (k < s->min) ? k : s->min;
+    s->max = (k > s->max) ? k : s->max;
+}
+
+static inline
+void stats_merge(struct btstats *s, struct btstats const *part) {
+    s->count += part->count;
+    s->sum += part->sum;
+    s->min = (part->min < s->min) ? part->min : s->min;
+    s->max = (part->max > s->max) ? part->max : s->max;
+}
+
+/* after a split moved keys or children between nodes */
+static
+void stats_compute(struct btnode *node) {
+    node->stats = (struct btstats) { 0, 0, INT_MAX, INT_MIN };
+    if (node->ntype == LEAF) {
+	for (int i = 0; i < node->ksz; i++)
+	    stats_add(&node->stats, node->keys[i], entry_count(node, i));
+    } else {
+	for (int i = 0; i <= node->ksz; i++)
+	    stats_merge(&node->stats, &node->values[i].child->stats);
+    }
+}
+
+/* |node| holds keys in [lb, ub) */
+static
+void range_stats(struct btnode *node, long int lb, long int ub,
+		 long int lo, long int hi, struct btstats *acc) {
+    if (lo <= lb && ub <= hi) {
+	stats_merge(acc, &node->stats);
+	return;
+    }
+    if (node->ntype == LEAF) {
+	for (int i = 0; i < node->ksz; i++)
+	    if (node->keys[i] >= lo && node->keys[i] < hi)
+		stats_add(acc, node->keys[i], entry_count(node, i));
+	return;
+    }
+    for (int i = 0; i <= node->ksz; i++) {
+	long int clb = (i > 0) ? node->keys[i-1] : lb;
+	long int cub = (i < node->ksz) ? node->keys[i] : ub;
+	if (cub > lo && clb < hi)
+	    range_stats(node->values[i].child, clb, cub, lo, hi, acc);
+    }
+}
+
+/* the stats of the keys in [lo, hi), visiting O(log n) nodes */
+struct btstats btree_range(struct btree *bt, long int lo, long int hi) {
+    struct btstats acc = { 0, 0, INT_MAX, INT_MIN };
+    if (lo < hi)
+	range_stats(bt->root, INT_MIN, (long int) INT_MAX + 1, lo, hi, &acc);
+    return acc;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 static inline
@@ -383,6 +500,7 @@ struct split_pair leaf_split(struct btnode *full) {
 	if (bset_isset(full->idref, j + full->ksz))
 	    bset_set(sibling->idref, j);
 
+    sibling->values[MAXKEYS].child = full->values[MAXKEYS].child;
     full->values[MAXKEYS].child = sibling;
     struct split_pair ret = { sibling, sibling->keys[0] };
     return ret;
@@ -398,9 +516,12 @@ struct split_pair insert_leaf_helper(struct btnode *node, int k, int id, bool le
 	    leaf_insert(node, k, id, leading);
 	else
 	    leaf_insert(split_result.sibling, k, id, leading);
+	stats_compute(node);
+	stats_compute(split_result.sibling);
 	return split_result;
     } else {
 	leaf_insert(node, k, id, leading);
+	stats_add(&node->stats, k, 1);
 	return null;
     }
 }
@@ -449,7 +570,10 @@ int redistribute(struct btnode *left, struct btnode *right, int pivot) {
     struct btnode *ptr = left->values[left->ksz].child;
     left->ksz--;
     int new_pivot = left->keys[left->ksz];
-    node_insert(right, pivot, ptr);
+    // ptr holds the keys below |pivot|: it becomes the first child of right
+    key_insert(right->keys, 0, right->ksz, pivot);
+    right->ksz++;
+    insert_ptr_atpos(right->values, 0, right->ksz, ptr);
     return new_pivot;
 }
 
@@ -480,8 +604,18 @@ struct split_pair insert(struct btnode *node, int k, int id, bool leading) {
 	int i = 0;
 	while (i < node->ksz && k >= node->keys[i]) i++;
 	struct split_pair result = insert(node->values[i].child, k, id, leading);
-	if (result.sibling == NULL) return null; // no split
-	return insert_node_helper(node, result.sibling, result.pivot);
+	if (result.sibling == NULL) {   // no split
+	    stats_add(&node->stats, k, 1);
+	    return null;
+	}
+	struct split_pair split = insert_node_helper(node, result.sibling, result.pivot);
+	if (split.sibling == NULL) {
+	    stats_add(&node->stats, k, 1);
+	} else {
+	    stats_compute(node);
+	    stats_compute(split.sibling);
+	}
+	return split;
     } else {
 	return insert_leaf_helper(node, k, id, leading);
     }
@@ -498,6 +632,7 @@ void btree_insert(struct btree *bt, int k, int id) {
 	root->values[root->ksz].child = bt->root;
 	root->ksz++;
 	root->values[root->ksz].child = p.sibling;
+	stats_compute(root);
 	bt->root = root;
 	bt->node_count++;
 	//print_vec(p.sibling->keys, p.sibling->ksz);
@@ -160,29 +160,39 @@ void send_file(int client_socket, message *send_message) {
     log_info("\tunmapped");
 }
 
-void display(int nbytes, char (*payload)[nbytes], enum result_type payload_type, int count) {
-    if (payload_type == DOUBLE_VAL) {
-        long double *vals = (long double *)payload;
-        for (size_t i = 0; i < nbytes / sizeof(long double); i++)
-            fprintf(stderr, "%Lf\n", vals[i]);
-    } else if (payload_type == VECTOR) {
-        int *vec = (int *)payload;
-        size_t items_in_col = (nbytes / sizeof(int)) / count;
-        for (size_t r = 0; r < items_in_col; r++) {
-            for (int c = 0; c < count; c++) {
-                if (c == count - 1)
-                    fprintf(stderr, "%d\n", vec[r + c * items_in_col]);
-                else
-                    fprintf(stderr, "%d,", vec[r + c * items_in_col]);
-            }
+size_t value_width(enum result_type type) {
+    switch (type) {
+        case DOUBLE_VAL: case DOUBLE_VECTOR: return sizeof(long double);
+        case LONG_VAL: case LONG_VECTOR: return sizeof(long int);
+        case VECTOR: return sizeof(int);
+        default:
+            log_err("received unknown payload response\n");
+            exit(1);
+    }
+}
+
+void display_value(enum result_type type, char *col, size_t r) {
+    if (type == DOUBLE_VAL || type == DOUBLE_VECTOR)
+        fprintf(stderr, "%Lf", ((long double *)col)[r]);
+    else if (type == LONG_VECTOR || type == LONG_VAL)
+        fprintf(stderr, "%ld", ((long int *)col)[r]);
+    else
+        fprintf(stderr, "%d", ((int *)col)[r]);
+}
+
+/* prints the columns side by side, one row per line */
+void display(int count, column_header *headers, char **cols) {
+    size_t rows = 0;
+    for (int c = 0; c < count; c++) {
+        size_t n = headers[c].length / value_width(headers[c].type);
+        if (n > rows) rows = n;
+    }
+    for (size_t r = 0; r < rows; r++) {
+        for (int c = 0; c < count; c++) {
+            if (r < headers[c].length / value_width(headers[c].type))
+                display_value(headers[c].type, cols[c], r);
+            fputc((c == count - 1) ? '\n' : ',', stderr);
         }
-    } else if (payload_type == LONG_VECTOR || payload_type == LONG_VAL) {
-        long int *vals = (long int *)payload;
-        for (size_t i = 0; i < nbytes / sizeof(long int); i++)
-            fprintf(stderr, "%ld\n", vals[i]);
-    } else {
-        log_err("received unknown payload response\n");
-        exit(1);
     }
 }
 
@@ -215,17 +225,27 @@ void send_command(int client_socket, message *send_message) {
             int num_bytes = recv_message.length;
             //log_info("num_bytes = %d, status = %d, count = %d\n", num_bytes, recv_message.status, count);
             if (recv_message.status == OK_WAIT_FOR_RESPONSE && num_bytes > 0) {
-                int collen = num_bytes / count;
-                char payload[count][collen];
+                // each column comes after its own header
+                column_header headers[count];
+                char *cols[count];
                 for (int c = 0; c < count; c++) {
-                    len = recv(client_socket, payload[c], collen, MSG_WAITALL);
-                    //log_info("debug len = %d collen = %d\n", len, collen);
+                    len = recv(client_socket, &headers[c], sizeof headers[c], MSG_WAITALL);
+                    if (len < (int) sizeof headers[c]) {
+                        log_err("Failed to receive column header.");
+                        exit(1);
+                    }
+                    cols[c] = malloc(headers[c].length + 1);
+                    assert(cols[c]);
+                    len = recv(client_socket, cols[c], headers[c].length, MSG_WAITALL);
+                    //log_info("debug len = %d collen = %d\n", len, headers[c].length);
                     if (len < 0) {
                         log_err("Failed to receive message.");
                         exit(1);
                     }
                 }
-                display(num_bytes, payload, recv_message.payload_type, count);
+                display(count, headers, cols);
+                for (int c = 0; c < count; c++)
+                    free(cols[c]);
             }
         } else {
             if (len < 0) {
@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "cscan.h"
+#include "tpool.h"
+#include "utils.h"
+
+/* values per chunk and thread: 256KB, read once for every attached scan */
+#define CSCAN_CHUNK (1 << 16)
+
+/*
+ * Cooperative scans. Concurrent selects over the same column attach to one
+ * sweep that walks the column chunk by chunk in a circle. A scan arriving
+ * mid-sweep starts at the chunk the sweep reads next and detaches once it
+ * has seen every chunk; each chunk sets its own words of the scan's bitmap,
+ * so the order chunks are read in does not matter.
+ *
+ * One of the attached scans drives: it applies every attached predicate to
+ * the current chunk, split in morsels over the execution pool, while the
+ * others wait. When its own scan completes it
+ * hands the sweep over to one of the waiting scans.
+ */
+struct cscan {
+    struct scanq *q;
+    size_t left;	// chunks still to visit
+    bool done;
+    struct cscan *next;
+};
+
+struct sweep {
+    const int *vals;
+    size_t sz;
+    size_t chunk;	// values per chunk
+    size_t nchunks;
+    size_t cursor;	// next chunk to read
+    bool driven;
+    size_t nscans;
+    struct cscan *scans;
+    struct sweep *next;
+};
+
+/* a single lock: it is only held to attach, detach and advance the cursor */
+static pthread_mutex_t sweeps_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t progress = PTHREAD_COND_INITIALIZER;
+static struct sweep *sweeps;
+
+static
+struct sweep *sweep_get(const int *vals, size_t sz) {
+    for (struct sweep *sw = sweeps; sw; sw = sw->next)
+	if (sw->vals == vals && sw->sz == sz) return sw;
+
+    struct sweep *sw = malloc(sizeof *sw);
+    assert(sw);
+    sw->vals = vals;
+    sw->sz = sz;
+    struct tpool *tp = exec_pool();
+    sw->chunk = CSCAN_CHUNK * ((tp) ? tpool_size(tp) + 1 : 1);
+    sw->nchunks = (sz + sw->chunk - 1) / sw->chunk;
+    sw->cursor = 0;
+    sw->driven = false;
+    sw->nscans = 0;
+    sw->scans = NULL;
+    sw->next = sweeps;
+    sweeps = sw;
+    return sw;
+}
+
+static
+void sweep_put(struct sweep *sw) {
+    if (sw->nscans > 0 || sw->driven) return;
+    for (struct sweep **p = &sweeps; *p; p = &(*p)->next) {
+	if (*p == sw) {
+	    *p = sw->next;
+	    break;
+	}
+    }
+    free(sw);
+}
+
+static
+void detach(struct sweep *sw, struct cscan *s) {
+    for (struct cscan **p = &sw->scans; *p; p = &(*p)->next) {
+	if (*p == s) {
+	    *p = s->next;
+	    break;
+	}
+    }
+    sw->nscans--;
+    s->done = true;
+}
+
+/* called and returns with sweeps_lock held */
+static
+void drive(struct sweep *sw, struct cscan *self) {
+    size_t capacity = 0;
+    struct cscan **attached = NULL;
+    struct scanq **qs = NULL;
+
+    while (!self->done) {
+	size_t chunk = sw->cursor;
+	sw->cursor = (chunk + 1) % sw->nchunks;
+
+	if (sw->nscans > capacity) {
+	    capacity = sw->nscans * 2;
+	    attached = realloc(attached, capacity * sizeof *attached);
+	    qs = realloc(qs, capacity * sizeof *qs);
+	    assert(attached && qs);
+	}
+	size_t n = 0;
+	for (struct cscan *s = sw->scans; s; s = s->next) {
+	    qs[n] = s->q;
+	    attached[n++] = s;
+	}
+	pthread_mutex_unlock(&sweeps_lock);
+
+	size_t base = chunk * sw->chunk;
+	size_t len = (sw->sz - base < sw->chunk) ? sw->sz - base : sw->chunk;
+	morsel_scan(qs, n, sw->vals, base, len);
+
+	pthread_mutex_lock(&sweeps_lock);
+	bool finished = false;
+	for (size_t j = 0; j < n; j++) {
+	    if (--attached[j]->left == 0) {
+		detach(sw, attached[j]);
+		finished = true;
+	    }
+	}
+	if (finished) pthread_cond_broadcast(&progress);
+    }
+
+    /* hand-off: a waiting scan of this sweep takes over */
+    sw->driven = false;
+    pthread_cond_broadcast(&progress);
+    free(attached);
+    free(qs);
+}
+
+/*
+ * Evaluates the select |q| over the column |vals| of |sz| values, sharing
+ * the pass with any other coop_scan() of the same column in progress.
+ */
+void coop_scan(struct scanq *q, const int *vals, size_t sz) {
+    if (sz == 0) return;
+
+    pthread_mutex_lock(&sweeps_lock);
+    struct sweep *sw = sweep_get(vals, sz);
+
+    struct cscan self = { .q = q, .left = sw->nchunks, .done = false,
+			  .next = sw->scans };
+    sw->scans = &self;
+    sw->nscans++;
+    cs165_log(stderr, "coop_scan: attached at chunk %zu with %zu scans\n",
+	      sw->cursor, sw->nscans);
+
+    while (!self.done) {
+	if (!sw->driven) {
+	    sw->driven = true;
+	    drive(sw, &self);
+	    sweep_put(sw);	// the last driver frees the sweep
+	} else {
+	    pthread_cond_wait(&progress, &sweeps_lock);
+	}
+    }
+    pthread_mutex_unlock(&sweeps_lock);
+}
@@ -0,0 +1,95 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "cvec.h"
+#include "bitmap.h"
+#include "plan.h"
+
+/*
+ * Intermediate results are reference counted by the names bound to them:
+ * a fresh cvec has no references, every map_insert() retains it and
+ * rebinding or freeing a name releases it.
+ */
+struct cvec *cvec_alloc(void) {
+    struct cvec *cv = malloc(sizeof *cv);
+    assert(cv);
+    cv->refs = 0;
+    cv->num_tuples = 0;
+    cv->values = NULL;
+    return cv;
+}
+
+struct cvec *cvec_retain(struct cvec *cv) {
+    cv->refs++;
+    return cv;
+}
+
+void cvec_release(struct cvec *cv) {
+    assert(cv->refs > 0);
+    if (--cv->refs == 0) cvec_free(cv);
+}
+
+void cvec_free(struct cvec *cv) {
+    switch(cv->type) {
+        case VECTOR: free(cv->values); break;
+        case LONG_VECTOR: free(cv->long_values); break;
+        case DOUBLE_VECTOR: free(cv->double_values); break;
+        case BITMAP: free(cv->bits); break;
+        case DOUBLE_VAL: case LONG_VAL: case RANGE: break;
+        case PENDING: plan_free(cv->plan); break;
+    }
+    free(cv);
+}
+
+/*
+ * A selection of |count| out of |nbits| positions, taking over |bits|. The
+ * bitmap is kept when it is the smaller form, that is when more than one
+ * position in 32 qualifies; sparser selections become position lists.
+ */
+struct cvec *cvec_from_bits(uint64_t *bits, size_t nbits, size_t count) {
+    struct cvec *cv = cvec_alloc();
+    cv->num_tuples = count;
+    if (count > nbits / 32) {
+        cv->type = BITMAP;
+        cv->bits = bits;
+        cv->nbits = nbits;
+        return cv;
+    }
+
+    cv->type = VECTOR;
+    cv->values = malloc(count * sizeof *cv->values);
+    assert(cv->values || count == 0);
+    bitmap_positions(cv->values, bits, nbits);
+    free(bits);
+    return cv;
+}
+
+/* the positions [start, end) */
+struct cvec *cvec_range(size_t start, size_t end) {
+    struct cvec *cv = cvec_alloc();
+    cv->type = RANGE;
+    cv->num_tuples = end - start;
+    cv->start = start;
+    cv->end = end;
+    return cv;
+}
+
+/*
+ * Turns a bitmap or a range into a position list, for operators that only
+ * take those.
+ */
+void cvec_flatten(struct cvec *cv) {
+    if (cv == NULL || (cv->type != BITMAP && cv->type != RANGE)) return;
+
+    int *values = malloc(cv->num_tuples * sizeof *values);
+    assert(values || cv->num_tuples == 0);
+    if (cv->type == BITMAP) {
+        bitmap_positions(values, cv->bits, cv->nbits);
+        free(cv->bits);
+    } else {
+        for (size_t j = 0; j < cv->num_tuples; j++)
+            values[j] = cv->start + j;
+    }
+    cv->values = values;
+    cv->type = VECTOR;
+}
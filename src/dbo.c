@@ -244,6 +244,7 @@ db_operator *cmd_load(char *rawdata) {
     char *tbl_name_end = strchr(rawdata, COMMA);
     ptrdiff_t len = tbl_name_end - rawdata;
     char tbl_name[len + 1];
+    tbl_name[len] = '\0';
     strncpy(tbl_name, rawdata, len);
     char *col_dot = strrchr(tbl_name, '.');
     *col_dot = '\0';
@@ -254,7 +255,10 @@ db_operator *cmd_load(char *rawdata) {
 }
 
 /** aggregates **/
-db_operator *cmd_avg(size_t argc, const char **argv) {
+
+/* res=agg(vals): |agg| of a column or of a result */
+static
+db_operator *aggregate_operator(size_t argc, const char **argv, enum aggr agg) {
     (void)argc;
     db_operator *dbo = malloc(sizeof *dbo);
     if (dbo == NULL) return NULL;
@@ -269,49 +273,29 @@ db_operator *cmd_avg(size_t argc, const char **argv) {
             break;
         case INVALID_VARTYPE: assert(false);
     }
-    dbo->agg = AVG;
+    dbo->agg = agg;
     dbo->assign_var = strdup(argv[1]);
     return dbo;
 }
 
+db_operator *cmd_avg(size_t argc, const char **argv) {
+    return aggregate_operator(argc, argv, AVG);
+}
+
 db_operator *cmd_min(size_t argc, const char **argv) {
-    (void)argc;
-    db_operator *dbo = malloc(sizeof *dbo);
-    if (dbo == NULL) return NULL;
-    switch(map_gettype(argv[0])) {
-        case ENTITY:
-            dbo->columns = map_get(argv[0]);
-            dbo->type = AGGREGATE_COL;
-            break;
-        case RESULT:
-            dbo->vals1 = map_get(argv[0]);
-            dbo->type = AGGREGATE_RES;
-            break;
-        case INVALID_VARTYPE: assert(false);
-    }
-    dbo->agg = MIN;
-    dbo->assign_var = strdup(argv[1]);
-    return dbo;
+    return aggregate_operator(argc, argv, MIN);
 }
 
 db_operator *cmd_max(size_t argc, const char **argv) {
-    (void)argc;
-    db_operator *dbo = malloc(sizeof *dbo);
-    if (dbo == NULL) return NULL;
-    switch(map_gettype(argv[0])) {
-        case ENTITY:
-            dbo->columns = map_get(argv[0]);
-            dbo->type = AGGREGATE_COL;
-            break;
-        case RESULT:
-            dbo->vals1 = map_get(argv[0]);
-            dbo->type = AGGREGATE_RES;
-            break;
-        case INVALID_VARTYPE: assert(false);
-    }
-    dbo->assign_var = strdup(argv[1]);
-    dbo->agg = MAX;
-    return dbo;
+    return aggregate_operator(argc, argv, MAX);
+}
+
+db_operator *cmd_count(size_t argc, const char **argv) {
+    return aggregate_operator(argc, argv, COUNT);
+}
+
+db_operator *cmd_sum(size_t argc, const char **argv) {
+    return aggregate_operator(argc, argv, SUM);
 }
 
 /** vector ops **/
@@ -352,6 +336,56 @@ db_operator *cmd_join(size_t argc, const char **argv) {
     return dbo;
 }
 
+/* a column or a result, in |col| or |res| */
+static
+void group_operand(const char *name, column **col, struct cvec **res) {
+    *col = NULL;
+    *res = NULL;
+    switch(map_gettype(name)) {
+        case ENTITY: *col = map_get(name); break;
+        case RESULT: *res = map_get(name); break;
+        case INVALID_VARTYPE: assert(false);
+    }
+}
+
+/* keys,res1,...,resn=groupby(keys,vals1,agg1,...,valsn,aggn) */
+db_operator *cmd_groupby(size_t argc, const char **argv) {
+    static const struct {
+        const char *name;
+        enum aggr agg;
+    } aggs[] = {
+        { "avg", AVG }, { "count", COUNT }, { "max", MAX }, { "min", MIN }, { "sum", SUM },
+    };
+    if (argc < 6 || argc % 3) return NULL;
+    size_t nvals = (argc - 3) / 3;
+    enum aggr found[nvals];
+    for (size_t v = 0; v < nvals; v++) {
+        size_t j = 0;
+        while (j < sizeof aggs / sizeof *aggs && strcmp(argv[2 + 2 * v], aggs[j].name)) j++;
+        if (j == sizeof aggs / sizeof *aggs) return NULL;
+        found[v] = aggs[j].agg;
+    }
+
+    db_operator *dbo = malloc(sizeof *dbo);
+    if (dbo == NULL) return NULL;
+    dbo->columns2 = malloc(nvals * sizeof *dbo->columns2);
+    dbo->tuple = malloc(nvals * sizeof *dbo->tuple);
+    dbo->aggs = malloc(nvals * sizeof *dbo->aggs);
+    dbo->assign_vars = malloc((nvals + 1) * sizeof *dbo->assign_vars);
+    assert(dbo->columns2 && dbo->tuple && dbo->aggs && dbo->assign_vars);
+
+    group_operand(argv[0], &dbo->columns, &dbo->vals1);
+    for (size_t v = 0; v < nvals; v++) {
+        group_operand(argv[1 + 2 * v], &dbo->columns2[v], &dbo->tuple[v]);
+        dbo->aggs[v] = found[v];
+    }
+    for (size_t j = 0; j <= nvals; j++)
+        dbo->assign_vars[j] = strdup(argv[1 + 2 * nvals + j]);
+    dbo->tuple_count = nvals;
+    dbo->type = GROUP;
+    return dbo;
+}
+
 db_operator *cmd_update(size_t argc, const char **argv) {
     (void)argc;
     db_operator *dbo = malloc(sizeof *dbo);
@@ -365,6 +399,36 @@ db_operator *cmd_update(size_t argc, const char **argv) {
     return dbo;
 }
 
+db_operator *cmd_free(size_t argc, const char **argv) {
+    (void)argc;
+    db_operator *dbo = malloc(sizeof *dbo);
+    if (dbo == NULL) return NULL;
+
+    dbo->assign_var = strdup(argv[0]);
+    dbo->type = FREE;
+
+    return dbo;
+}
+
+/** shared scans **/
+db_operator *cmd_batch_queries(size_t argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+    db_operator *dbo = malloc(sizeof *dbo);
+    if (dbo == NULL) return NULL;
+    dbo->type = BATCH_QUERIES;
+    return dbo;
+}
+
+db_operator *cmd_batch_execute(size_t argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+    db_operator *dbo = malloc(sizeof *dbo);
+    if (dbo == NULL) return NULL;
+    dbo->type = BATCH_EXECUTE;
+    return dbo;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 db_operator *cmd_rel_delete(size_t argc, const char **argv) {
@@ -373,9 +437,59 @@ db_operator *cmd_rel_delete(size_t argc, const char **argv) {
     return NULL;
 }
 
+/*
+ * positions of vals1/pos1 with a match in vals2, or without one: only the
+ * values of the right input are read, so it takes no positions
+ */
+static
+db_operator *semi_operator(size_t argc, const char **argv, OperatorType type) {
+    if (argc != 5) return NULL;
+    db_operator *dbo = malloc(sizeof *dbo);
+    if (dbo == NULL) return NULL;
+
+    dbo->vals1 = map_get(argv[0]);
+    dbo->pos1 = map_get(argv[1]);
+    dbo->vals2 = map_get(argv[2]);
+    dbo->pos2 = NULL;
+    dbo->assign_var = strdup(argv[3]);
+    dbo->type = type;
+    return dbo;
+}
+
+db_operator *cmd_semijoin(size_t argc, const char **argv) {
+    return semi_operator(argc, argv, SEMI_JOIN);
+}
+
+db_operator *cmd_antijoin(size_t argc, const char **argv) {
+    return semi_operator(argc, argv, ANTI_JOIN);
+}
+
+/*
+ * f,d1,..,dk=starjoin(fpos,fk1,dvals1,dpos1,..,fkk,dvalsk,dposk): the fact
+ * positions and the keys fetched at them for each of k dimensions, joined
+ * with the values and positions of each dimension.
+ */
+db_operator *cmd_starjoin(size_t argc, const char **argv) {
+    if (argc < 7 || (argc - 3) % 4) return NULL;
+    size_t ndims = (argc - 3) / 4, nops = 1 + 3 * ndims;
+    db_operator *dbo = malloc(sizeof *dbo);
+    if (dbo == NULL) return NULL;
+
+    dbo->tuple = malloc(nops * sizeof *dbo->tuple);
+    dbo->assign_vars = malloc((ndims + 1) * sizeof *dbo->assign_vars);
+    assert(dbo->tuple && dbo->assign_vars);
+    for (size_t j = 0; j < nops; j++)
+        dbo->tuple[j] = map_get(argv[j]);
+    for (size_t j = 0; j <= ndims; j++)
+        dbo->assign_vars[j] = strdup(argv[nops + j]);
+    dbo->tuple_count = nops;
+    dbo->type = STAR_JOIN;
+    return dbo;
+}
+
 db_operator *cmd_mergejoin(size_t argc, const char **argv) {
-    (void)argc;
-    (void)argv;
-    return NULL;
+    db_operator *dbo = cmd_join(argc, argv);
+    if (dbo) dbo->type = MERGE_JOIN;
+    return dbo;
 }
 
@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include "parse.h"
 #include "symtable.h"
@@ -18,16 +19,32 @@
 #include "btree.h"
 #include "vector.h"
 #include "sync.h"
-
-#define DEFAULT_TABLE_COUNT 8
+#include "cvec.h"
+#include "session.h"
+#include "sscan.h"
+#include "cscan.h"
+#include "tpool.h"
+#include "simd.h"
+#include "bitmap.h"
+#include "plan.h"
+#include "fuse.h"
+#include "pipe.h"
+#include "group.h"
+#include "join.h"
+#include "aggr.h"
+
+/* tables of a database: names and columns point into the array, so it never grows */
+#define DEFAULT_TABLE_COUNT 32
 
 #define L1CACHE_SIZE (2<<17)
-#define NUMBUCKETS 997
+/* columns from this size on are scanned in morsels over the execution pool */
+#define PARALLEL_SCAN_MIN (1 << 16)
+/* values sampled to guess if a scan should emit positions or a bitmap */
+#define SCAN_SAMPLE 256
 
-struct bucket {
-    struct sindex *items;
-    int length;
-};
+/* queries of different clients run concurrently on the worker pool; readers
+ * share the database while anything that modifies it runs alone */
+static pthread_rwlock_t db_lock = PTHREAD_RWLOCK_INITIALIZER;
 
 static
 struct db *create_db(char *db_name) {
@@ -47,7 +64,10 @@ struct table *create_table(db* db, char* name, size_t max_cols) {
     t.col = malloc(sizeof(struct column) * max_cols);
     assert(t.col);
 
-    // TODO: add the logic for resizing; max tables are 7 in tests
+    if (db->table_count == db->capacity) {
+        free(t.col);
+        return NULL;
+    }
     db->tables[db->table_count] = t;
     return &db->tables[db->table_count++];;
 }
@@ -69,6 +89,7 @@ struct column *create_column(table *table, char *name, bool sorted) {
 static
 void create_index(struct column *col, enum index_type type) {
     // TODO: case where col->index->index == NULL: load after create cmd
+    bloom_free(&col->bloom);    // the index answers point selects
     switch(type) {
         case SORTED:
             col->index = malloc(sizeof *col->index);
@@ -88,7 +109,7 @@ void create_index(struct column *col, enum index_type type) {
 }
 
 static status create(db_operator *query) {
-    status st;
+    status st = { OK, NULL };
     db *db;
     table *tbl;
     column *col;
@@ -102,9 +123,9 @@ static status create(db_operator *query) {
             break;
         case(CREATE_TBL):
             tbl = create_table(query->db, query->create_name, query->table_size);
-            ret = map_insert(query->assign_var, tbl, ENTITY);
+            ret = tbl && map_insert(query->assign_var, tbl, ENTITY);
             st.code = ret ? OK : ERROR;
-            st.message = "table created";
+            st.message = (tbl) ? "table created" : "too many tables";
             cs165_log(stderr, "%s %s\n", st.message, query->create_name);
             break;
         case(CREATE_COL):
@@ -148,19 +169,23 @@ void index_insert(struct column *c, int val, size_t pos, size_t sz) {
 static inline
 void column_insert(struct column *col, int value, size_t pos) {
     vector_insert(&col->data, value, pos);
+    zonemap_insert(&col->zones, col->data.vals, col->data.sz, pos);
+    bloom_insert(&col->bloom, col->data.vals, col->data.sz, pos);
     col->status = MODIFIED;
 }
 
 static inline
 size_t column_sorted_insert(struct column *col, int value) {
     size_t pos = vector_insert_sorted(&col->data, value);
+    zonemap_insert(&col->zones, col->data.vals, col->data.sz, pos);
+    bloom_insert(&col->bloom, col->data.vals, col->data.sz, pos);
     col->status = MODIFIED;
     return pos;
 }
 
 static
 status rel_insert(struct table *tbl, int *row) {
-    status st;
+    status st = { OK, NULL };
 
     if (tbl->clustered < tbl->col_count) {
         size_t pos = column_sorted_insert(&tbl->col[tbl->clustered], row[tbl->clustered]);
@@ -186,12 +211,15 @@ status rel_insert(struct table *tbl, int *row) {
 
 static
 struct status update_col(int value, struct column *col, struct cvec *pos) {
-    status st;
+    status st = { OK, NULL };
     int *data = col->data.vals;
     int *indixes = pos->values;
 
-    for (size_t j = 0; j < pos->num_tuples; j++)
+    for (size_t j = 0; j < pos->num_tuples; j++) {
         data[indixes[j]] = value;
+        zonemap_update(&col->zones, indixes[j], value);
+        bloom_update(&col->bloom, indixes[j], value);
+    }
 
     return st;
 }
@@ -306,7 +334,7 @@ void mk_cluster(struct table *tbl) {
 
 static
 struct status bulk_load(struct table *tbl, char *rawdata) {
-    struct status st;
+    struct status st = { OK, NULL };
 
     int row[tbl->col_count];
     char *nl = "\n";
@@ -324,8 +352,13 @@ struct status bulk_load(struct table *tbl, char *rawdata) {
 
     if (tbl->clustered < tbl->col_count) mk_cluster(tbl);
 
-    for (size_t j = 0; j < tbl->col_count; j++)
-        tbl->col[j].status = MODIFIED;
+    for (size_t j = 0; j < tbl->col_count; j++) {
+        struct column *col = &tbl->col[j];
+        zonemap_build(&col->zones, col->data.vals, col->data.sz);
+        if (col->index == NULL && !col->clustered)
+            bloom_build(&col->bloom, col->data.vals, col->data.sz);
+        col->status = MODIFIED;
+    }
 
     //cs165_log(stderr, "bulk load complete, %d\n", tbl->length);
     return st;
@@ -387,34 +420,107 @@ int indexOf(int *a, int key, int sz) {
     return -1;
 }
 
+/* a clustered column keeps the qualifying positions together */
 static inline
-size_t scan_clustered(int **v, int low, int high, size_t sz, int *vals) {
+struct cvec *scan_clustered(int low, int high, size_t sz, int *vals) {
+    if (low >= high) return cvec_range(0, 0);
     int low_idx = index_of_left(vals, low, sz);
-    int high_idx = index_of_right(vals, high, sz);
+    int high_idx = index_of_right(vals, high - 1, sz);
     //bool flag = low_idx == -1 || high_idx == -1 || low_idx > high_idx;
 
     size_t num_tuples = low_idx > high_idx ? 0 : high_idx - low_idx + 1;
     cs165_log(stderr, "scan_clustered: %d %d %zu\n", low_idx, high_idx, num_tuples);
-    int *vec = malloc(num_tuples * sizeof *vec);
-    for (size_t j = 0; j < num_tuples; j++)
-        vec[j] = low_idx + j;
-    *v = vec;
-    return num_tuples;
+    if (num_tuples == 0) return cvec_range(0, 0);
+    return cvec_range(low_idx, high_idx + 1);
 }
 
+/* a selection with less than one value in 32 qualifying is kept as positions */
 static inline
-size_t scan_unsorted(int **v, int low, int high, size_t sz, int *vals) {
-    size_t num_tuples = 0;
-    int *vec = malloc(sizeof(int) * sz);
-    for (size_t j = 0; j < sz; j++) {
-        vec[num_tuples] = j;
-        num_tuples += (vals[j] >= low && vals[j] < high);
-        /* if (data->vals[j] >= low && data->vals[j] < high)
-            vec[num_tuples++] = j; */
+bool looks_sparse(struct scanq const *q, size_t sz, int *vals) {
+    size_t n = (sz < SCAN_SAMPLE) ? sz : SCAN_SAMPLE;
+    size_t hits = 0;
+    for (size_t j = 0; j < n; j++) {
+        int v = vals[j * (sz / n)];
+        hits += (q->point) ? (v == q->low) : (v >= q->low && v < q->high);
+    }
+    return hits * 32 < n;
+}
+
+/* the zone map of |col|, if it covers the data */
+static inline
+const struct zone *col_zones(struct column const *col) {
+    size_t nzones = (col->data.sz + ZONE_SIZE - 1) / ZONE_SIZE;
+    return (col->zones.nzones == nzones) ? col->zones.zones : NULL;
+}
+
+/* the Bloom filters of |col|, if it has them for all of its data */
+static inline
+const struct bloom *col_bloom(struct column const *col) {
+    size_t nzones = (col->data.sz + ZONE_SIZE - 1) / ZONE_SIZE;
+    return (col->bloom.words && col->bloom.nzones == nzones) ? &col->bloom : NULL;
+}
+
+/* positions of the qualifying values in a zone of a private sparse scan */
+static inline
+size_t scan_zone(int *out, struct scanq const *q, const int *vals, size_t base, size_t n) {
+    switch (sscan_zone(q, base / ZONE_SIZE)) {
+        case ZONE_NONE: return 0;
+        case ZONE_ALL:
+            for (size_t j = 0; j < n; j++)
+                out[j] = base + j;
+            return n;
+        case ZONE_SOME: break;
+    }
+    return (q->point) ? simd_point(out, vals + base, n, q->low, base)
+                      : simd_range(out, vals + base, n, q->low, q->high, base);
+}
+
+/*
+ * Scans an unsorted column. Large columns are scanned cooperatively with
+ * the other clients or in morsels on the execution pool, into a bitmap;
+ * the result keeps whichever of bitmap and position list is smaller. A
+ * private scan guesses from a sample and writes positions directly when
+ * few values should qualify. Zones the zone map rules out are not read.
+ */
+static
+struct cvec *scan_column(struct scanq q, struct column *col) {
+    size_t sz = col->data.sz;
+    int *vals = col->data.vals;
+    q.zones = col_zones(col);
+    q.bloom = col_bloom(col);
+
+    if (sz < PARALLEL_SCAN_MIN && looks_sparse(&q, sz, vals)) {
+        int *vec = malloc(sizeof(int) * sz);
+        size_t num_tuples = 0;
+        for (size_t base = 0; base < sz; base += ZONE_SIZE) {
+            size_t n = (sz - base < ZONE_SIZE) ? sz - base : ZONE_SIZE;
+            num_tuples += scan_zone(vec + num_tuples, &q, vals, base, n);
+        }
+        struct cvec *ret = cvec_alloc();
+        ret->num_tuples = num_tuples;
+        ret->values = realloc(vec, sizeof(int) * num_tuples);
+        ret->type = VECTOR;
+        return ret;
     }
-    cs165_log(stderr, "scan_unsorted: %zu\n", num_tuples);
-    *v = realloc(vec, sizeof(int) * num_tuples);
-    return num_tuples;
+
+    q.bits = bitmap_alloc(sz);
+    q.num_tuples = 0;
+    struct scanq *qs = &q;
+    if (sz >= CSCAN_MIN_SIZE)
+        coop_scan(&q, vals, sz);
+    else if (sz >= PARALLEL_SCAN_MIN)
+        morsel_scan(&qs, 1, vals, 0, sz);
+    else
+        q.num_tuples = sscan_block(&q, vals, 0, sz);
+    return cvec_from_bits(q.bits, sz, q.num_tuples);
+}
+
+static inline
+struct cvec *scan_unsorted(int low, int high, struct column *col) {
+    struct scanq q = { .low = low, .high = high, .point = false };
+    struct cvec *ret = scan_column(q, col);
+    cs165_log(stderr, "scan_unsorted: %zu\n", ret->num_tuples);
+    return ret;
 }
 
 static inline
@@ -432,43 +538,29 @@ size_t search_until(int *vals, size_t sz, int start_idx, int value, bool up) {
 }
 
 static inline
-size_t select_clustered(int **v, int value, size_t sz, int *vals) {
+struct cvec *select_clustered(int value, size_t sz, int *vals) {
     int idx = indexOf(vals, value, sz);
-
-    if (idx == -1) {
-        *v = NULL;
-        return 0;
-    }
+    if (idx == -1) return cvec_range(0, 0);
 
     int low_idx = search_until(vals, sz, idx, value, false);
     int high_idx = search_until(vals, sz, idx, value, true);
     size_t num_tuples = high_idx - low_idx + 1;
 
-    cs165_log(stderr, "select_clustered: %zu %zu %zu\n", low_idx, high_idx, num_tuples);
-    int *vec = malloc(num_tuples * sizeof *vec);
-    for (size_t j = 0; j < num_tuples; j++)
-        vec[j] = low_idx + j;
-    *v = vec;
-
-    return num_tuples;
+    cs165_log(stderr, "select_clustered: %d %d %zu\n", low_idx, high_idx, num_tuples);
+    return cvec_range(low_idx, high_idx + 1);
 }
 
 static inline
-size_t select_unsorted(int **v, int value, size_t sz, int *vals) {
-    size_t num_tuples = 0;
-    int *vec = malloc(sizeof(int) * sz);
-    for (size_t j = 0; j < sz; j++) {
-        vec[num_tuples] = j;
-        num_tuples += (vals[j] == value);
-    }
-    cs165_log(stderr, "select_unsorted: %zu\n", num_tuples);
-    *v = realloc(vec, sizeof(int) * num_tuples);
-    return num_tuples;
+struct cvec *select_unsorted(int value, struct column *col) {
+    struct scanq q = { .low = value, .point = true };
+    struct cvec *ret = scan_column(q, col);
+    cs165_log(stderr, "select_unsorted: %zu\n", ret->num_tuples);
+    return ret;
 }
 
 static
 struct status select_col(int value, struct column *col, struct cvec **r) {
-    status st;
+    status st = { OK, NULL };
     struct vec const *data = &col->data;
     struct vec *btree_result = NULL;
     size_t num_tuples = 0;
@@ -480,20 +572,24 @@ struct status select_col(int value, struct column *col, struct cvec **r) {
                 break;
             case BTREE:
                 btree_result = btree_search(col->index->index, value);
+                if (btree_result == NULL) break;
                 num_tuples = btree_result->sz;
                 vec = btree_result->vals;
+                free(btree_result);
                 cs165_log(stderr, "btree_scan: %zu\n", num_tuples);
                 break;
             case IDX_INVALID: assert(false);
         }
     } else if (col->clustered) {
-        num_tuples = select_clustered(&vec, value, data->sz, data->vals);
+        *r = select_clustered(value, data->sz, data->vals);
+        return st;
     } else {
-        num_tuples = select_unsorted(&vec, value, data->sz, data->vals);
+        *r = select_unsorted(value, col);
+        return st;
     }
 
     //cs165_log(stdout, "select: sz %d, low %d, high %d, num_tuples %d\n", data->sz, low, high, num_tuples);
-    struct cvec *ret = malloc(sizeof(struct cvec));
+    struct cvec *ret = cvec_alloc();
     ret->num_tuples = num_tuples;
     ret->values = vec;
     ret->type = VECTOR;
@@ -504,7 +600,7 @@ struct status select_col(int value, struct column *col, struct cvec **r) {
 
 static
 struct status col_scan(int low, int high, struct column *col, struct cvec **r) {
-    status st;
+    status st = { OK, NULL };
     struct vec const *data = &col->data;
     struct vec *btree_result = NULL;
     size_t num_tuples = 0;
@@ -518,18 +614,21 @@ struct status col_scan(int low, int high, struct column *col, struct cvec **r) {
                 btree_result = btree_rsearch(col->index->index, low, high);
                 num_tuples = btree_result->sz;
                 vec = btree_result->vals;
+                free(btree_result);
                 cs165_log(stderr, "btree_scan: %zu\n", num_tuples);
                 break;
             case IDX_INVALID: assert(false);
         }
     } else if (col->clustered) {
-        num_tuples = scan_clustered(&vec, low, high, data->sz, data->vals);
+        *r = scan_clustered(low, high, data->sz, data->vals);
+        return st;
     } else {
-        num_tuples = scan_unsorted(&vec, low, high, data->sz, data->vals);
+        *r = scan_unsorted(low, high, col);
+        return st;
     }
 
     //cs165_log(stdout, "select: sz %d, low %d, high %d, num_tuples %d\n", data->sz, low, high, num_tuples);
-    struct cvec *ret = malloc(sizeof(struct cvec));
+    struct cvec *ret = cvec_alloc();
     ret->num_tuples = num_tuples;
     ret->values = vec;
     ret->type = VECTOR;
@@ -538,19 +637,40 @@ struct status col_scan(int low, int high, struct column *col, struct cvec **r) {
     return st;
 }
 
+/* clears the positions of |pos| whose value is out of range */
+static
+struct cvec *bitmap_scan(int low, int high, struct cvec *pos, int *vals) {
+    uint64_t *bits = bitmap_alloc(pos->nbits);
+    size_t k = 0, num_tuples = 0;
+    for (size_t w = 0; w < BITMAP_WORDS(pos->nbits); w++) {
+        uint64_t word = pos->bits[w];
+        for (uint64_t rest = word; rest; rest &= rest - 1) {
+            int v = vals[k++];
+            if (!(v >= low && v < high))
+                word &= ~(rest & -rest);
+        }
+        bits[w] = word;
+        num_tuples += __builtin_popcountll(word);
+    }
+    return cvec_from_bits(bits, pos->nbits, num_tuples);
+}
+
 static
 struct status vec_scan(int low, int high, struct cvec *pos, struct cvec *vals, struct cvec **r) {
-    status st;
+    status st = { OK, NULL };
+
+    if (pos->type == BITMAP) {
+        *r = bitmap_scan(low, high, pos, vals->values);
+        return st;
+    }
 
     size_t const length = pos->num_tuples;
-    size_t num_tuples = 0;
     int *vec = malloc(sizeof(int) * length);
-    for (size_t j = 0; j < length; j++) {
-        vec[num_tuples] = pos->values[j];
-        num_tuples += (vals->values[j] >= low && vals->values[j] < high);
-    }
+    size_t num_tuples = (pos->type == RANGE)
+        ? simd_range(vec, vals->values, length, low, high, pos->start)
+        : simd_range_pos(vec, pos->values, vals->values, length, low, high);
 
-    struct cvec *ret = malloc(sizeof(struct cvec));
+    struct cvec *ret = cvec_alloc();
     ret->num_tuples = num_tuples;
     ret->values = realloc(vec, sizeof(int) * num_tuples);;
     //TODO LONG_VECTOR
@@ -563,17 +683,124 @@ struct status vec_scan(int low, int high, struct cvec *pos, struct cvec *vals, s
     //cs165_log(stdout, "select: sz %d, low %d, high %d, num_tuples %d\n", length, low, high, num_tuples);
 //////////////////////////////////////////////////////////////////////////////
 
+static inline
+bool is_batchable(db_operator *q) {
+    return q->type == SELECT || q->type == POINT_SELECT;
+}
+
+/* selects that would scan the whole column; the others are index lookups */
+static inline
+bool shares_scan(struct column *col) {
+    return col->index == NULL && !col->clustered;
+}
+
+static inline
+struct status run_select(db_operator *q, struct cvec **r) {
+    if (q->type == POINT_SELECT)
+        return select_col(q->select, q->columns, r);
+    return col_scan(q->range.low, q->range.high, q->columns, r);
+}
+
+/*
+ * Runs the selects deferred since batch_queries(). Selects over the same
+ * unsorted column share one scan; results are bound in submission order so
+ * a name assigned twice keeps the later result.
+ */
+static
+struct status batch_execute(struct session *s) {
+    struct status st = { OK, "batch executed" };
+    size_t n = s->batch_sz;
+    db_operator **qs = s->batch;
+    struct cvec **results = calloc(n, sizeof *results);
+    struct scanq *group = malloc(n * sizeof *group);
+    size_t *members = malloc(n * sizeof *members);
+    assert(results && group && members);
+
+    for (size_t i = 0; i < n; i++) {
+        if (results[i] != NULL) continue;
+        struct column *col = qs[i]->columns;
+
+        if (!shares_scan(col)) {
+            run_select(qs[i], &results[i]);
+            continue;
+        }
+
+        size_t k = 0;
+        for (size_t j = i; j < n; j++) {
+            if (qs[j]->columns != col || results[j] != NULL) continue;
+            struct scanq q = { .low = 0, .high = 0, .point = false,
+                               .bits = bitmap_alloc(col->data.sz),
+                               .zones = col_zones(col), .bloom = col_bloom(col),
+                               .num_tuples = 0 };
+            if (qs[j]->type == POINT_SELECT) {
+                q.low = qs[j]->select;
+                q.point = true;
+            } else {
+                q.low = qs[j]->range.low;
+                q.high = qs[j]->range.high;
+            }
+            group[k] = q;
+            members[k++] = j;
+        }
+
+        shared_scan(group, k, col->data.vals, col->data.sz);
+
+        for (size_t g = 0; g < k; g++)
+            results[members[g]] = cvec_from_bits(group[g].bits, col->data.sz,
+                                                 group[g].num_tuples);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (results[i] != NULL) {
+            map_insert(qs[i]->assign_var, results[i], RESULT);
+        } else {
+            free(qs[i]->assign_var);
+            st.code = ERROR;
+            st.message = "batched select failed";
+        }
+        free(qs[i]);
+    }
+
+    s->batch_sz = 0;
+    s->batching = false;
+    free(results);
+    free(group);
+    free(members);
+    return st;
+}
+
+/* gathers vals at the positions of a bitmap, copying runs of 64 at once */
+static
+void bitmap_fetch(int *out, const int *vals, struct cvec *pos) {
+    size_t k = 0;
+    for (size_t w = 0; w < BITMAP_WORDS(pos->nbits); w++) {
+        uint64_t word = pos->bits[w];
+        if (word == UINT64_MAX) {
+            memcpy(out + k, vals + w * 64, 64 * sizeof *out);
+            k += 64;
+            continue;
+        }
+        for (; word; word &= word - 1)
+            out[k++] = vals[w * 64 + __builtin_ctzll(word)];
+    }
+}
+
 static
 status res_fetch(struct cvec *res, struct cvec *pos, struct cvec **r) {
-    status st;
+    status st = { OK, NULL };
 
     int *resv = malloc(sizeof(int) * pos->num_tuples);
-    assert(resv);
+    assert(resv || pos->num_tuples == 0);
 
-    for (size_t j = 0; j < pos->num_tuples; j++)
-        resv[j] = res->values[pos->values[j]];
+    if (pos->type == BITMAP)
+        bitmap_fetch(resv, res->values, pos);
+    else if (pos->type == RANGE)
+        memcpy(resv, res->values + pos->start, pos->num_tuples * sizeof *resv);
+    else
+        for (size_t j = 0; j < pos->num_tuples; j++)
+            resv[j] = res->values[pos->values[j]];
 
-    struct cvec *ret = malloc(sizeof(struct cvec));
+    struct cvec *ret = cvec_alloc();
     cs165_log(stdout, "num_tuples in fetch: %d\n", pos->num_tuples);
 
     ret->num_tuples = pos->num_tuples;
@@ -585,15 +812,20 @@ status res_fetch(struct cvec *res, struct cvec *pos, struct cvec **r) {
 }
 
 static status col_fetch(struct column *col, struct cvec *v, struct cvec **r) {
-    status st;
+    status st = { OK, NULL };
 
     int *resv = malloc(sizeof(int) * v->num_tuples);
-    assert(resv);
+    assert(resv || v->num_tuples == 0);
 
-    for (size_t j = 0; j < v->num_tuples; j++)
-        resv[j] = col->data.vals[v->values[j]];
+    if (v->type == BITMAP)
+        bitmap_fetch(resv, col->data.vals, v);
+    else if (v->type == RANGE)
+        memcpy(resv, col->data.vals + v->start, v->num_tuples * sizeof *resv);
+    else
+        for (size_t j = 0; j < v->num_tuples; j++)
+            resv[j] = col->data.vals[v->values[j]];
 
-    struct cvec *ret = malloc(sizeof(struct cvec));
+    struct cvec *ret = cvec_alloc();
     cs165_log(stdout, "num_tuples in fetch: %d\n", v->num_tuples);
 
     ret->num_tuples = v->num_tuples;
@@ -607,7 +839,7 @@ static status col_fetch(struct column *col, struct cvec *v, struct cvec **r) {
 static
 struct status reconstruct(struct cvec **vecs, size_t count, struct cvec ***r) {
     (void) count;
-    status st;
+    status st = { OK, NULL };
     *r = vecs;
     /*
     for (int j = 0; j < 10; j++) {
@@ -621,13 +853,7 @@ struct status reconstruct(struct cvec **vecs, size_t count, struct cvec ***r) {
 
 static
 int find_max(int *vals, size_t sz, bool sorted) {
-    int max = vals[sz-1];
-    if (!sorted) {
-        for (size_t j = 0; j < sz-1; j++) {
-            int v = vals[j];
-            max = (v > max) ? v : max;
-        }
-    }
+    int max = (sorted && sz) ? vals[sz-1] : aggr_max(vals, sz, VECTOR);
     cs165_log(stderr, "max: %d\n", max);
     return max;
 }
@@ -635,26 +861,12 @@ int find_max(int *vals, size_t sz, bool sorted) {
 static
 int find_min(int *vals, size_t sz, bool sorted) {
     cs165_log(stderr, "called find_min\n");
-
-    int min = vals[0];
-    if (!sorted)
-        for (size_t j = 1; j < sz; j++) {
-            int v = vals[j];
-            min = (v < min) ? v : min;
-        }
-    return min;
+    return (sorted && sz) ? vals[0] : aggr_min(vals, sz, VECTOR);
 }
 
 static
 long double find_avg(int *vals, size_t sz) {
-    long double avg = 0.0;
-
-    long int sum = 0;
-    for (size_t j = 0; j < sz; j++)
-        sum += vals[j];
-
-    avg = (long double) sum / sz;
-
+    long double avg = (long double) aggr_sum(vals, sz, VECTOR) / sz;
     fprintf(stderr, "avg = %Lf\n", avg);
     return avg;
 }
@@ -665,19 +877,9 @@ static
 long double find_avg_res(void *vals, size_t sz, enum result_type type) {
     if (type == VECTOR)
         return find_avg(vals, sz);
-    assert(type == LONG_VECTOR);
-
-    long int *values = (long int *)vals;
-    long double avg = 0.0;
-
-    long int sum = 0;
-    for (size_t j = 0; j < sz; j++)
-        sum += values[j];
-
-    avg = (long double) sum / sz;
 
+    long double avg = (long double) aggr_sum(vals, sz, type) / sz;
     fprintf(stderr, "avg res = %Lf\n", avg);
-    //cs165_log(stderr, "average = %Lf\n", avg->dval);
     return avg;
 }
 
@@ -685,18 +887,9 @@ static
 long int find_max_res(void *vals, size_t sz, bool sorted, enum result_type type) {
     if (type == VECTOR)
         return find_max(vals, sz, sorted);
-    assert(type == LONG_VECTOR);
-
-    long int *values = (long int *)vals;
-    long int max = values[sz-1];
-    if (!sorted) {
-        for (size_t j = 0; j < sz-1; j++) {
-            long int v = values[j];
-            //if (v >= 2019184347) cs165_log(stderr, "\t%ld\n", v);
-            max = (v > max) ? v : max;
-        }
-    }
-    cs165_log(stderr, "max: %d\n", max);
+
+    long int max = (sorted && sz) ? ((long int *) vals)[sz-1] : aggr_max(vals, sz, type);
+    cs165_log(stderr, "max: %ld\n", max);
     return max;
 }
 
@@ -705,26 +898,108 @@ long int find_min_res(void *vals, size_t sz, bool sorted, enum result_type type)
     cs165_log(stderr, "called find_min_res\n");
     if (type == VECTOR)
         return find_min(vals, sz, sorted);
-    assert(type == LONG_VECTOR);
-    long int *values = (long int *)vals;
-    long int min = values[0];
-    if (!sorted)
-        for (size_t j = 1; j < sz; j++) {
-            long int v = values[j];
-            min = (v < min) ? v : min;
+    return (sorted && sz) ? ((long int *) vals)[0] : aggr_min(vals, sz, type);
+}
+
+/* a sum as a LONG_VAL, or as a DOUBLE_VAL when it does not fit a long */
+static inline
+void sum_value(struct cvec *val, __int128 sum) {
+    if (sum >= LONG_MIN && sum <= LONG_MAX) {
+        val->ival = sum;
+        val->type = LONG_VAL;
+    } else {
+        val->dval = sum;
+        val->type = DOUBLE_VAL;
+        cs165_log(stderr, "sum overflows a long: %Lg\n", val->dval);
+    }
+}
+
+/* aggregates of a selection are over its positions, which a bitmap has in order */
+static
+void aggregate_bits(struct cvec *pos, enum aggr agg, struct cvec *val) {
+    size_t nwords = BITMAP_WORDS(pos->nbits);
+    size_t w;
+    switch(agg) {
+        case MIN:
+            for (w = 0; w < nwords && pos->bits[w] == 0; w++) ;
+            val->ival = (w < nwords) ? (long) (w * 64 + __builtin_ctzll(pos->bits[w])) : 0;
+            val->type = LONG_VAL;
+            break;
+        case MAX:
+            for (w = nwords; w > 0 && pos->bits[w - 1] == 0; w--) ;
+            val->ival = (w > 0) ? (long) ((w - 1) * 64 + 63 - __builtin_clzll(pos->bits[w - 1])) : 0;
+            val->type = LONG_VAL;
+            break;
+        case AVG: case SUM: {
+            long int sum = 0;
+            for (w = 0; w < nwords; w++)
+                for (uint64_t word = pos->bits[w]; word; word &= word - 1)
+                    sum += w * 64 + __builtin_ctzll(word);
+            if (agg == SUM) {
+                val->ival = sum;
+                val->type = LONG_VAL;
+            } else {
+                val->dval = (long double) sum / pos->num_tuples;
+                val->type = DOUBLE_VAL;
+            }
+            break;
         }
-    return min;
+        case COUNT:
+            val->ival = pos->num_tuples;
+            val->type = LONG_VAL;
+            break;
+    }
+}
+
+/* the positions of a range are consecutive: its aggregates are closed forms */
+static
+void aggregate_range(struct cvec *pos, enum aggr agg, struct cvec *val) {
+    bool empty = pos->num_tuples == 0;
+    switch(agg) {
+        case MIN:
+            val->ival = (empty) ? 0 : (long) pos->start;
+            val->type = LONG_VAL;
+            break;
+        case MAX:
+            val->ival = (empty) ? 0 : (long) pos->end - 1;
+            val->type = LONG_VAL;
+            break;
+        case AVG:
+            // an empty range averages to nan, like an empty position list
+            val->dval = (empty) ? 0.0L / 0.0L : (pos->start + pos->end - 1) / 2.0L;
+            val->type = DOUBLE_VAL;
+            break;
+        case COUNT:
+            val->ival = pos->num_tuples;
+            val->type = LONG_VAL;
+            break;
+        case SUM:
+            val->ival = (long) pos->num_tuples * (long) (pos->start + pos->end - 1) / 2;
+            val->type = LONG_VAL;
+            break;
+    }
 }
 
 static
 struct status aggregate_res(struct cvec *vals, enum aggr agg, struct cvec **r) {
     cs165_log(stderr, "called aggregate_res\n");
-    status st;
+    status st = { OK, NULL };
 
-    struct cvec *val = malloc(sizeof(struct cvec));
+    struct cvec *val = cvec_alloc();
     assert(val);
     val->num_tuples = 1;
 
+    if (vals->type == BITMAP) {
+        aggregate_bits(vals, agg, val);
+        *r = val;
+        return st;
+    }
+    if (vals->type == RANGE) {
+        aggregate_range(vals, agg, val);
+        *r = val;
+        return st;
+    }
+
     switch(agg) {
         case MIN:
             val->ival = find_min_res(vals->values, vals->num_tuples, false, vals->type);
@@ -738,25 +1013,34 @@ struct status aggregate_res(struct cvec *vals, enum aggr agg, struct cvec **r) {
             val->dval = find_avg_res(vals->values, vals->num_tuples, vals->type);
             val->type = DOUBLE_VAL;
             break;
+        case COUNT:
+            val->ival = vals->num_tuples;
+            val->type = LONG_VAL;
+            break;
+        case SUM:
+            sum_value(val, aggr_sum(vals->values, vals->num_tuples, vals->type));
+            break;
     }
     *r = val;
     return st;
 }
 //////////////////////////////////////////////////////////////////////////////
 
+/* the ends of a sorted index or the outer leaves of a btree */
 static
 int aggregate_max(struct column *c) {
     if (c->clustered)
         return find_max(c->data.vals, c->data.sz, true);
 
-    if (c->index)
+    if (c->index && c->data.sz) {
         switch (c->index->type) {
-            // TODO change to sindex fmin
-            case SORTED: break;
-            // TODO change to btree function
-            case BTREE: break;
+            case SORTED:
+                return ((struct sindex *) c->index->index)[c->data.sz - 1].val;
+            case BTREE:
+                return btree_max(c->index->index);
             case IDX_INVALID: assert(false);
         }
+    }
 
     return find_max(c->data.vals, c->data.sz, false);
 }
@@ -766,24 +1050,25 @@ int aggregate_min(struct column *c) {
     if (c->clustered)
         return find_min(c->data.vals, c->data.sz, true);
 
-    if (c->index) {
+    if (c->index && c->data.sz) {
         switch (c->index->type) {
-            // TODO change to sindex fmin
-            case SORTED: break;
-            // TODO change to btree function
-            case BTREE: break;
+            case SORTED:
+                return ((struct sindex *) c->index->index)[0].val;
+            case BTREE:
+                return btree_min(c->index->index);
             case IDX_INVALID: assert(false);
         }
     }
 
     return find_min(c->data.vals, c->data.sz, false);
 }
+
 static
 struct status aggregate_col(struct column *c, enum aggr agg, struct cvec **r) {
     cs165_log(stderr, "called aggregate_col\n");
-    status st;
+    status st = { OK, NULL };
 
-    struct cvec *val = malloc(sizeof(struct cvec));
+    struct cvec *val = cvec_alloc();
     assert(val);
     val->num_tuples = 1;
 
@@ -800,6 +1085,13 @@ struct status aggregate_col(struct column *c, enum aggr agg, struct cvec **r) {
             val->dval = find_avg(c->data.vals, c->data.sz);
             val->type = DOUBLE_VAL;
             break;
+        case COUNT:
+            val->ival = c->data.sz;
+            val->type = LONG_VAL;
+            break;
+        case SUM:
+            sum_value(val, aggr_sum(c->data.vals, c->data.sz, VECTOR));
+            break;
     }
 
     *r = val;
@@ -808,16 +1100,22 @@ struct status aggregate_col(struct column *c, enum aggr agg, struct cvec **r) {
 
 //////////////////////////////////////////////////////////////////////////////
 
+/* the value at |j| of an int vector or of the longs of an earlier add/sub */
+static inline
+long int vec_value(struct cvec const *v, size_t j) {
+    return (v->type == LONG_VECTOR) ? v->long_values[j] : v->values[j];
+}
+
 static
 struct status add_vecs(struct cvec *vals1, struct cvec *vals2, struct cvec **r) {
-    status st;
+    status st = { OK, NULL };
 
     size_t num_tuples = vals1->num_tuples;
     long int *addv = malloc(num_tuples * sizeof *addv);
     for (size_t j = 0; j < num_tuples; j++)
-        addv[j] = (long int) vals1->values[j] + (long int) vals2->values[j];
+        addv[j] = vec_value(vals1, j) + vec_value(vals2, j);
 
-    struct cvec *ret = malloc(sizeof(struct cvec));
+    struct cvec *ret = cvec_alloc();
     ret->num_tuples = num_tuples;
     ret->long_values = addv;
     ret->type = LONG_VECTOR;
@@ -828,14 +1126,14 @@ struct status add_vecs(struct cvec *vals1, struct cvec *vals2, struct cvec **r)
 
 static
 struct status sub_vecs(struct cvec *vals1, struct cvec *vals2, struct cvec **r) {
-    status st;
+    status st = { OK, NULL };
 
     size_t num_tuples = vals1->num_tuples;
     long int *addv = malloc(sizeof *addv * num_tuples);
     for (size_t j = 0; j < num_tuples; j++)
-        addv[j] = (long int) vals1->values[j] - (long int) vals2->values[j];
+        addv[j] = vec_value(vals1, j) - vec_value(vals2, j);
 
-    struct cvec *ret = malloc(sizeof(struct cvec));
+    struct cvec *ret = cvec_alloc();
     ret->num_tuples = num_tuples;
     ret->long_values = addv;
     ret->type = LONG_VECTOR;
@@ -850,7 +1148,7 @@ static
 struct status nl_join(struct cvec *vals1, struct cvec *pos1,
                       struct cvec *vals2, struct cvec *pos2,
                       struct cvec **rl, struct cvec **rr) {
-    status st;
+    status st = { OK, NULL };
 
     struct cvec *lres = vals1->num_tuples < vals2->num_tuples ? vals1 : vals2;
     int *lpos = pos1->num_tuples < pos2->num_tuples ? pos1->values : pos2->values;
@@ -878,13 +1176,13 @@ struct status nl_join(struct cvec *vals1, struct cvec *pos1,
                     }
         }
 
-    struct cvec *res1 = malloc(sizeof *res1);
+    struct cvec *res1 = cvec_alloc();
     res1->values = realloc(lmatch, sizeof(int) * lcount);
     res1->num_tuples = lcount;
     res1->type = VECTOR;
     *rl = res1;
 
-    struct cvec *res2 = malloc(sizeof *res2);
+    struct cvec *res2 = cvec_alloc();
     res2->values = realloc(rmatch, sizeof(int) * rcount);
     res2->num_tuples = rcount;
     res2->type = VECTOR;
@@ -894,116 +1192,601 @@ struct status nl_join(struct cvec *vals1, struct cvec *pos1,
     return st;
 }
 
-int probe(struct bucket *b, int val) {
-    int min = 0;
-    int max = b->length - 1;
-    int mid = 0;
 
-    if (b->length == 0) return -1;
+/*
+ * whether the operands of a join are values and positions of the same size;
+ * a semi or anti join has no positions for its right input
+ */
+static
+bool join_operands(db_operator *q) {
+    bool semi = q->type == SEMI_JOIN || q->type == ANTI_JOIN;
+    return q->vals1->type == VECTOR && q->pos1->type == VECTOR && q->vals2->type == VECTOR
+        && q->vals1->num_tuples == q->pos1->num_tuples
+        && (semi || (q->pos2->type == VECTOR && q->vals2->num_tuples == q->pos2->num_tuples));
+}
 
-    if (b->length == 1 && b->items[min].val == val) return min;
+/* an index join probes with at most one outer row per this many inner rows */
+#define INDEX_JOIN_RATIO 16
 
-    if (b->items[max].val < val) return -1;
+static void force(struct cvec *cv);
 
-    while(max >= min) {
-        mid = (min + max) / 2;
+/*
+ * Whether a join input is a pending fetch of a column with an index at a
+ * pending select on that same column, which an index join can probe
+ * without computing either. |ji| receives the index and the values the
+ * select keeps, with the bounds its own scan of that index applies.
+ */
+static
+bool join_indexed(struct cvec *vals, struct cvec *pos, struct join_index *ji) {
+    if (vals->type != PENDING || pos->type != PENDING) return false;
+    db_operator *fetch = vals->plan->op, *sel = pos->plan->op;
+    struct column *col = fetch->columns;
+    if (fetch->type != PROJECT || fetch->pos1 != pos || col->index == NULL
+            || (sel->type != SELECT && sel->type != POINT_SELECT) || sel->columns != col)
+        return false;
+
+    ji->type = col->index->type;
+    ji->index = col->index->index;
+    ji->sz = col->data.sz;
+    if (sel->type == POINT_SELECT) {
+        ji->lo = ji->hi = sel->select;
+    } else {
+        ji->lo = sel->range.low;
+        ji->hi = (long) sel->range.high - 1;
+    }
+    if (ji->lo > ji->hi) return false;
+    return true;
+}
+
+/* the rows an index join would probe */
+static
+size_t join_index_rows(struct join_index const *ji) {
+    return (ji->type == SORTED)
+        ? sindex_count(ji->lo, ji->hi + 1, ji->sz, ji->index)
+        : (size_t) btree_range(ji->index, ji->lo, ji->hi + 1).count;
+}
 
-        if (b->items[mid].val == val){
-            int v = mid;
-            while(v > 0 && b->items[v-1].val == val)
-                v--;
-            return v;
-        } else if (val > b->items[mid].val)
-            min = mid + 1;
-        else if (val < b->items[mid].val)
-            max = mid - 1;
+/*
+ * A JOIN probes the index of one input when the other is much smaller and
+ * hashes otherwise; a MERGE_JOIN sort-merges.
+ */
+static
+struct status join_rows(db_operator *q, struct cvec **rl, struct cvec **rr) {
+    struct status st = { ERROR, "join takes values and positions of the same size" };
+    struct join_index ji[2];
+    size_t rows[2] = { 0, 0 };
+    if (q->type == JOIN && join_indexed(q->vals1, q->pos1, &ji[0]))
+        rows[0] = join_index_rows(&ji[0]);
+    if (q->type == JOIN && join_indexed(q->vals2, q->pos2, &ji[1]))
+        rows[1] = join_index_rows(&ji[1]);
+    int inner = (rows[1] >= rows[0]) ? 1 : 0;
+
+    struct cvec *ops[4] = { q->vals1, q->pos1, q->vals2, q->pos2 };
+    struct cvec **outer = &ops[2 * (1 - inner)];
+    for (int j = 0; j < 2; j++) {
+        force(outer[j]);
+        cvec_flatten(outer[j]);
+    }
+    if (outer[0]->type == VECTOR && outer[1]->type == VECTOR
+            && outer[0]->num_tuples == outer[1]->num_tuples
+            && rows[inner] > 0 && outer[0]->num_tuples * INDEX_JOIN_RATIO <= rows[inner]) {
+        struct join_in o = { outer[0]->values, outer[1]->values, outer[0]->num_tuples };
+        join_index(&o, &ji[inner], inner == 1, rl, rr);
+        st.code = OK;
+        st.message = NULL;
+        return st;
     }
 
-    return -1;
+    for (int j = 0; j < 4; j++) {
+        force(ops[j]);
+        cvec_flatten(ops[j]);
+    }
+    if (!join_operands(q)) return st;
+
+    struct join_in l = { q->vals1->values, q->pos1->values, q->vals1->num_tuples };
+    struct join_in r = { q->vals2->values, q->pos2->values, q->vals2->num_tuples };
+    if (q->type == MERGE_JOIN)
+        join_merge(&l, &r, rl, rr);
+    else
+        join_radix(&l, &r, rl, rr);
+    st.code = OK;
+    st.message = NULL;
+    return st;
+}
+
+static
+struct status semi_rows(db_operator *q, struct cvec **r) {
+    struct status st = { ERROR, "join takes values and positions of the same size" };
+    if (!join_operands(q)) return st;
+
+    struct join_in l = { q->vals1->values, q->pos1->values, q->vals1->num_tuples };
+    struct join_in rt = { q->vals2->values, NULL, q->vals2->num_tuples };
+    join_semi(&l, &rt, q->type == ANTI_JOIN, r);
+    st.code = OK;
+    st.message = NULL;
+    return st;
+}
+
+/* inserts the results of a star join itself, as it has more than two */
+static
+struct status star_rows(db_operator *q) {
+    struct status st = { ERROR, "star join takes positions and keys of the same size" };
+    size_t ndims = (q->tuple_count - 1) / 3;
+    struct join_in facts[ndims], dims[ndims];
+    struct cvec *res[ndims + 1];
+    struct cvec *fpos = q->tuple[0];
+
+    bool ok = fpos && fpos->type == VECTOR;
+    for (size_t d = 0; ok && d < ndims; d++) {
+        struct cvec *fk = q->tuple[1 + 3 * d], *dv = q->tuple[2 + 3 * d], *dp = q->tuple[3 + 3 * d];
+        ok = fk && dv && dp && fk->type == VECTOR && dv->type == VECTOR && dp->type == VECTOR
+            && fk->num_tuples == fpos->num_tuples && dv->num_tuples == dp->num_tuples;
+        if (!ok) break;
+        facts[d] = (struct join_in) { fk->values, fpos->values, fk->num_tuples };
+        dims[d] = (struct join_in) { dv->values, dp->values, dv->num_tuples };
+    }
+
+    if (ok && join_star(facts, dims, ndims, res)) {
+        for (size_t j = 0; j <= ndims; j++)
+            map_insert(q->assign_vars[j], res[j], RESULT);
+        st.code = OK;
+        st.message = NULL;
+    } else {
+        if (ok) st.message = "star join takes too many dimensions";
+        for (size_t j = 0; j <= ndims; j++)
+            free(q->assign_vars[j]);
+    }
+    free(q->assign_vars);
+    free(q->tuple);
+    return st;
+}
+
+/* the rows of a GROUP operand, a column or a vector; false for a scalar */
+static
+bool group_input(struct column *col, struct cvec *res, struct group_in *in) {
+    if (col) {
+        *in = (struct group_in) { col->data.vals, col->data.sz, false };
+        return true;
+    }
+    switch(res->type) {
+        case VECTOR:
+            *in = (struct group_in) { res->values, res->num_tuples, false };
+            return true;
+        case LONG_VECTOR:
+            *in = (struct group_in) { res->long_values, res->num_tuples, true };
+            return true;
+        default:
+            return false;
+    }
+}
+
+static
+struct status group_rows(db_operator *q) {
+    struct status st = { ERROR, "group by takes vectors of the same size" };
+    size_t nvals = q->tuple_count;
+    struct group_in keys, vals[nvals];
+    struct cvec *res[nvals + 1];
+
+    bool ok = group_input(q->columns, q->vals1, &keys);
+    for (size_t v = 0; ok && v < nvals; v++)
+        ok = group_input(q->columns2[v], q->tuple[v], &vals[v]) && vals[v].n == keys.n;
+
+    if (ok) {
+        group_by(keys, vals, q->aggs, nvals, &res[0], &res[1]);
+        for (size_t j = 0; j <= nvals; j++)
+            map_insert(q->assign_vars[j], res[j], RESULT);
+        st.code = OK;
+        st.message = NULL;
+    } else {
+        for (size_t j = 0; j <= nvals; j++)
+            free(q->assign_vars[j]);
+    }
+    free(q->assign_vars);
+    free(q->columns2);
+    free(q->tuple);
+    free(q->aggs);
+    return st;
 }
 
 static inline
-int hash(int i) {
-    return i & (NUMBUCKETS - 1);
+bool modifies_db(OperatorType type) {
+    switch(type) {
+        case CREATE: case BULK_LOAD: case INSERT: case DELETE: case UPDATE:
+            return true;
+        default:
+            return false;
+    }
 }
 
+//////////////////////////////////////////////////////////////////////////////
+
 static
-struct status simple_hash_join(struct cvec *v1, struct cvec *p1,
-                               struct cvec *v2, struct cvec *p2,
-                               struct cvec **rl, struct cvec **rr) {
+struct cvec *agg_result(struct agg_acc const *acc, enum aggr agg) {
+    struct cvec *val = cvec_alloc();
+    val->num_tuples = 1;
+    switch(agg) {
+        case MIN:
+            val->ival = (acc->count) ? acc->min : 0;
+            val->type = LONG_VAL;
+            break;
+        case MAX:
+            val->ival = (acc->count) ? acc->max : 0;
+            val->type = LONG_VAL;
+            break;
+        case AVG:
+            val->dval = (long double) acc->sum / acc->count;
+            val->type = DOUBLE_VAL;
+            break;
+        case COUNT:
+            val->ival = acc->count;
+            val->type = LONG_VAL;
+            break;
+        case SUM:
+            sum_value(val, acc->sum);
+            break;
+    }
+    return val;
+}
 
-    struct status st;
+/* the scan a pending select on a column without an index would run */
+static
+struct scanq select_scanq(db_operator *sel) {
+    struct column *col = sel->columns;
+    struct scanq q = { .low = 0, .high = 0, .point = false,
+                       .zones = col_zones(col), .bloom = col_bloom(col) };
+    if (sel->type == POINT_SELECT) {
+        q.low = sel->select;
+        q.point = true;
+    } else {
+        q.low = sel->range.low;
+        q.high = sel->range.high;
+    }
+    return q;
+}
 
-    int *sdata = v1->num_tuples < v2->num_tuples ? v1->values : v2->values;
-    int *spos = p1->num_tuples < p2->num_tuples ? p1->values : p2->values;
-    size_t slen = p1->num_tuples < p2->num_tuples ? p1->num_tuples : p2->num_tuples;
+/*
+ * The aggregate of a pending fetch, computed from the fetched column
+ * without gathering the values. When the positions come from a pending
+ * select that scans its column, the select runs fused in the same pass and
+ * no position list is built either. NULL if there is nothing to fuse.
+ */
+static
+struct cvec *fused_aggregate(struct cvec *vals, enum aggr agg) {
+    if (vals->type != PENDING || vals->plan->op->type != PROJECT) return NULL;
+    db_operator *fetch = vals->plan->op;
+    struct column *fcol = fetch->columns;
+    struct cvec *pos = fetch->pos1;
+    db_operator *sel = (pos->type == PENDING) ? pos->plan->op : NULL;
+    struct agg_acc acc;
+
+    if (sel && (sel->type == SELECT || sel->type == POINT_SELECT)
+            && shares_scan(sel->columns) && sel->columns->data.sz == fcol->data.sz) {
+        struct scanq q = select_scanq(sel);
+        fuse_select_aggregate(&q, sel->columns->data.vals, fcol->data.vals,
+                              sel->columns->data.sz, &acc);
+    } else if (sel == NULL) {
+        fuse_gather_aggregate(fcol->data.vals, pos, &acc);
+    } else {
+        return NULL;
+    }
+    return agg_result(&acc, agg);
+}
 
-    int *rdata = v1->num_tuples < v2->num_tuples ? v2->values : v1->values;
-    int *rpos = p1->num_tuples < p2->num_tuples ? p2->values : p1->values;
-    size_t rlen = p1->num_tuples < p2->num_tuples ? p2->num_tuples : p1->num_tuples;
+/*
+ * Pipelines. pipe_values() describes a pending fetch or add/sub as an
+ * expression of |p| over the positions it stores in |pos|; pipe_positions()
+ * makes |pos| the source of |p|, with a filter for each pending select2.
+ * What cannot stream, an index lookup or a result that is not pending, is
+ * forced and read as it is. |above| counts the nodes still owed to the
+ * callers, so a tree too large for |p| is given up before it is walked; an
+ * operand used twice is one node.
+ */
+static
+struct pipe_expr *pipe_values(struct pipe *p, struct cvec *vals, struct cvec **pos,
+                              size_t above) {
+    if (vals->type != PENDING || vals->plan->unpiped) return NULL;
+    if (p->nexprs + above >= PIPE_MAX_EXPRS) return NULL;
+    db_operator *q = vals->plan->op;
+    struct pipe_expr *e = NULL;
 
-    int bucket_count[NUMBUCKETS] = {0};
+    switch(q->type) {
+        case(PROJECT):
+            e = pipe_node(p, PIPE_FETCH);
+            if (e) e->vals = q->columns->data.vals;
+            *pos = q->pos1;
+            return e;
+        case(ADD): case(SUB): {
+            struct cvec *lpos = NULL, *rpos = NULL;
+            struct pipe_expr *l = pipe_values(p, q->vals1, &lpos, above + 1);
+            if (l == NULL) return NULL;
+            struct pipe_expr *r = l;
+            rpos = lpos;
+            if (q->vals2 != q->vals1)
+                r = pipe_values(p, q->vals2, &rpos, above + 1);
+            if (r == NULL || lpos != rpos) return NULL;
+            e = pipe_node(p, (q->type == ADD) ? PIPE_ADD : PIPE_SUB);
+            if (e) {
+                e->left = l;
+                e->right = r;
+            }
+            *pos = lpos;
+            return e;
+        }
+        default:
+            return NULL;
+    }
+}
 
-    for (size_t i = 0; i < slen; i++) {
-        int v = sdata[i];
-        int k = hash(v);
-        bucket_count[k]++;
+static
+bool pipe_positions(struct pipe *p, struct cvec *pos) {
+    db_operator *q = (pos->type == PENDING) ? pos->plan->op : NULL;
+
+    if (q && (q->type == SELECT || q->type == POINT_SELECT) && shares_scan(q->columns)) {
+        p->q = select_scanq(q);
+        p->svals = q->columns->data.vals;
+        p->sz = q->columns->data.sz;
+        return true;
+    }
+    if (q && q->type == SELECT2) {
+        struct cvec *vpos = NULL;
+        struct pipe_expr *e = pipe_values(p, q->vals1, &vpos, 0);
+        return e && vpos == q->pos1 && pipe_positions(p, q->pos1)
+            && pipe_filter(p, e, q->range.low, q->range.high);
     }
 
-    struct bucket *buckets[NUMBUCKETS];
+    force(pos);
+    if (pos->type != VECTOR && pos->type != BITMAP && pos->type != RANGE) return false;
+    p->pos = pos;
+    return true;
+}
 
-    for (int k = 0; k < NUMBUCKETS; k++) {
-        struct bucket *b = malloc(sizeof *b);
-        b->items = malloc(sizeof(struct sindex) * bucket_count[k]);
-        b->length = 0;
-        buckets[k] = b;
+/*
+ * The count of a pending select, from the bounds of its range in the
+ * index or from a fused scan: no position is materialized. NULL when the
+ * select is computed anyway, a clustered range or a result.
+ */
+static
+struct cvec *count_select(struct cvec *pos) {
+    if (pos->type != PENDING) return NULL;
+    db_operator *sel = pos->plan->op;
+    if (sel->type != SELECT && sel->type != POINT_SELECT) return NULL;
+    struct column *col = sel->columns;
+    int low = (sel->type == POINT_SELECT) ? sel->select : sel->range.low;
+    long int high = (sel->type == POINT_SELECT) ? (long) sel->select + 1 : sel->range.high;
+    struct agg_acc acc = { .count = 0 };
+
+    if (col->index && col->index->type == SORTED) {
+        acc.count = sindex_count(low, high, col->data.sz, col->index->index);
+    } else if (col->index && col->index->type == BTREE) {
+        acc.count = btree_range(col->index->index, low, high).count;
+    } else if (shares_scan(col)) {
+        struct scanq q = select_scanq(sel);
+        fuse_select_aggregate(&q, col->data.vals, col->data.vals, col->data.sz, &acc);
+    } else {
+        return NULL;
     }
+    cs165_log(stderr, "count_select: %zu\n", acc.count);
+    return agg_result(&acc, COUNT);
+}
 
-    for (size_t i = 0; i < slen; i++) {
-        int v = sdata[i];
-        int k = hash(v);
-        struct bucket *b = buckets[k];
-        b->items[b->length].val = v;
-        b->items[b->length++].pos = spos[i];
+/*
+ * The aggregate of a pending fetch of a column at a pending select on the
+ * same column, read off the stats its B+tree keeps per node. NULL when
+ * the column has no B+tree.
+ */
+static
+struct cvec *index_aggregate(struct cvec *vals, enum aggr agg) {
+    if (vals->type != PENDING || vals->plan->op->type != PROJECT) return NULL;
+    db_operator *fetch = vals->plan->op;
+    struct column *col = fetch->columns;
+    struct cvec *pos = fetch->pos1;
+    if (pos->type != PENDING || col->index == NULL || col->index->type != BTREE)
+        return NULL;
+    db_operator *sel = pos->plan->op;
+    if ((sel->type != SELECT && sel->type != POINT_SELECT) || sel->columns != col)
+        return NULL;
+
+    struct btstats s = (sel->type == POINT_SELECT)
+        ? btree_range(col->index->index, sel->select, (long) sel->select + 1)
+        : btree_range(col->index->index, sel->range.low, sel->range.high);
+    struct agg_acc acc = { .min = s.min, .max = s.max, .sum = s.sum, .count = s.count };
+    cs165_log(stderr, "index_aggregate: %zu\n", acc.count);
+    return agg_result(&acc, agg);
+}
+
+/* a pending aggregate of a pending fetch or add/sub, pipelined */
+static
+struct cvec *pipelined_aggregate(struct cvec *vals, enum aggr agg) {
+    struct pipe p;
+    struct cvec *pos = NULL;
+    pipe_init(&p);
+    p.out = pipe_values(&p, vals, &pos, 0);
+    if (p.out == NULL || !pipe_positions(&p, pos)) {
+        if (vals->type == PENDING) vals->plan->unpiped = true;
+        return NULL;
     }
 
-    for (int k = 0; k < NUMBUCKETS; k++)
-        if (buckets[k]->length > 1)
-            qsort(buckets[k]->items, buckets[k]->length,
-                  sizeof (struct sindex), sindex_val_cmp);
+    struct agg_acc acc;
+    pipe_aggregate(&p, &acc);
+    return agg_result(&acc, agg);
+}
+
+/*
+ * A pending select2, fetch or add/sub of pending operands, pipelined.
+ * A plan that fails is marked, so forcing what reads it does not walk it
+ * again.
+ */
+static
+struct cvec *pipelined(struct cvec *cv) {
+    struct pipe p;
+    struct cvec *pos = cv;
+    pipe_init(&p);
+    if (cv->plan->unpiped) return NULL;
+    if (cv->plan->op->type != SELECT2)
+        p.out = pipe_values(&p, cv, &pos, 0);
+    if ((cv->plan->op->type != SELECT2 && p.out == NULL) || !pipe_positions(&p, pos)) {
+        cv->plan->unpiped = true;
+        return NULL;
+    }
+    return pipe_collect(&p);
+}
 
-    int *rmatch = malloc(sizeof(int) * rlen * 2);
-    int *smatch = malloc(sizeof(int) * rlen * 2);
-    int match_count = 0;
+/* the results an operator that is not deferred reads */
+static
+void force_operands(db_operator *q) {
+    switch(q->type) {
+        case(PROJECT): case(UPDATE):
+            force(q->pos1);
+            break;
+        case(AGGREGATE_RES):
+            force(q->vals1);
+            break;
+        case(PROJECT_RES): case(SELECT2):
+            force(q->pos1);
+            force(q->vals1);
+            break;
+        case(ADD): case(SUB):
+            force(q->vals1);
+            force(q->vals2);
+            break;
+        case(GROUP):
+            force(q->vals1);
+            for (size_t j = 0; j < q->tuple_count; j++)
+                force(q->tuple[j]);
+            break;
+        case(JOIN):
+            // join_rows forces the operands it reads
+            break;
+        case(MERGE_JOIN):
+            force(q->vals1);
+            force(q->pos1);
+            force(q->vals2);
+            force(q->pos2);
+            break;
+        case(SEMI_JOIN): case(ANTI_JOIN):
+            force(q->vals1);
+            force(q->pos1);
+            force(q->vals2);
+            break;
+        case(TUPLE): case(STAR_JOIN):
+            for (size_t j = 0; j < q->tuple_count; j++)
+                force(q->tuple[j]);
+            break;
+        default: break;
+    }
+}
 
-    for (size_t r = 0; r < rlen; r++) {
-        int v = rdata[r];
-        int k = hash(v);
-        struct bucket *b = buckets[k];
-        int s = probe(b, v);
+/* operands that must be position lists rather than bitmaps */
+static
+void flatten_operands(db_operator *q) {
+    switch(q->type) {
+        case(PROJECT_RES): case(SELECT2):
+            cvec_flatten(q->vals1);
+            break;
+        case(ADD): case(SUB):
+            cvec_flatten(q->vals1);
+            cvec_flatten(q->vals2);
+            break;
+        case(GROUP):
+            cvec_flatten(q->vals1);
+            for (size_t j = 0; j < q->tuple_count; j++)
+                cvec_flatten(q->tuple[j]);
+            break;
+        case(JOIN): case(MERGE_JOIN):
+            cvec_flatten(q->vals1);
+            cvec_flatten(q->pos1);
+            cvec_flatten(q->vals2);
+            cvec_flatten(q->pos2);
+            break;
+        case(SEMI_JOIN): case(ANTI_JOIN):
+            cvec_flatten(q->vals1);
+            cvec_flatten(q->pos1);
+            cvec_flatten(q->vals2);
+            break;
+        case(UPDATE):
+            cvec_flatten(q->pos1);
+            break;
+        case(TUPLE): case(STAR_JOIN):
+            for (size_t j = 0; j < q->tuple_count; j++)
+                cvec_flatten(q->tuple[j]);
+            break;
+        default: break;
+    }
+}
 
-        while(s != -1) {
-            smatch[match_count] = b->items[s].pos;
-            rmatch[match_count++] = rpos[r];
-            s = (s + 1 < b->length && b->items[s + 1].val == v) ? s + 1 : -1;
-        }
+/* whether a deferred select2, fetch or add/sub reads a pending result */
+static inline
+bool pending_operands(db_operator *q) {
+    switch(q->type) {
+        case(PROJECT):
+            return q->pos1->type == PENDING;
+        case(SELECT2):
+            return q->pos1->type == PENDING || q->vals1->type == PENDING;
+        case(ADD): case(SUB):
+            return q->vals1->type == PENDING || q->vals2->type == PENDING;
+        default:
+            return false;
     }
+}
 
-    struct cvec *res1 = malloc(sizeof *res1);
-    res1->values = realloc(smatch, sizeof(int) * match_count);
-    res1->num_tuples = match_count;
-    res1->type = VECTOR;
-    *rl = res1;
+/* computes a pending result in place: names and plans keep pointing to it */
+static
+void force(struct cvec *cv) {
+    if (cv == NULL || cv->type != PENDING) return;
+    struct plan *p = cv->plan;
+    db_operator *q = p->op;
+    struct cvec *r = NULL;
 
-    struct cvec *res2 = malloc(sizeof *res2);
-    res2->values = realloc(rmatch, sizeof(int) * match_count);
-    res2->num_tuples = match_count;
-    res2->type = VECTOR;
-    *rr = res2;
+    switch(q->type) {
+        case(SELECT):
+            col_scan(q->range.low, q->range.high, q->columns, &r);
+            break;
+        case(POINT_SELECT):
+            select_col(q->select, q->columns, &r);
+            break;
+        case(PROJECT): case(SELECT2): case(ADD): case(SUB):
+            if (pending_operands(q) && (r = pipelined(cv)) != NULL) break;
+            force_operands(q);
+            flatten_operands(q);
+            if (q->type == PROJECT)
+                col_fetch(q->columns, q->pos1, &r);
+            else if (q->type == SELECT2)
+                vec_scan(q->range.low, q->range.high, q->pos1, q->vals1, &r);
+            else if (q->type == ADD)
+                add_vecs(q->vals1, q->vals2, &r);
+            else
+                sub_vecs(q->vals1, q->vals2, &r);
+            break;
+        case(AGGREGATE_RES):
+            if (q->agg == COUNT) r = count_select(q->vals1);
+            if (r == NULL) r = index_aggregate(q->vals1, q->agg);
+            if (r == NULL) r = fused_aggregate(q->vals1, q->agg);
+            if (r == NULL) r = pipelined_aggregate(q->vals1, q->agg);
+            if (r == NULL) {
+                force(q->vals1);
+                aggregate_res(q->vals1, q->agg, &r);
+            }
+            break;
+        default: assert(false);
+    }
 
-    cs165_log(stdout, "num_tuples in nl_join: %d and %d\n", match_count);
+    if (r == NULL) {
+        cs165_log(stderr, "force: no result, taken as empty\n");
+        r = cvec_alloc();
+        r->type = VECTOR;
+    }
+    size_t refs = cv->refs;
+    *cv = *r;
+    cv->refs = refs;
+    free(r);
+    plan_free(p);
+}
 
-    return st;
+/* before a modification: deferred queries see the data they were issued on */
+static
+void force_all(void) {
+    for (struct plan *p = plan_first(); p; p = plan_first())
+        force(p->result);
 }
 
 static
@@ -1016,6 +1799,11 @@ void load_columns(db_operator *q) {
         case(SELECT) : case(PROJECT) : case(AGGREGATE_COL) : case(POINT_SELECT):
             load_column(q->columns);
             break;
+        case(GROUP):
+            if (q->columns) load_column(q->columns);
+            for (size_t j = 0; j < q->tuple_count; j++)
+                if (q->columns2[j]) load_column(q->columns2[j]);
+            break;
         default: break;
     }
 }
@@ -1031,8 +1819,37 @@ struct status execute_db_operator(db_operator *query, struct cvec ***result) {
 
     struct cvec *r = NULL;
     struct cvec *r2 = NULL;
+
+    if (modifies_db(query->type))
+        pthread_rwlock_wrlock(&db_lock);
+    else
+        pthread_rwlock_rdlock(&db_lock);
+
     load_columns(query);
 
+    struct session *session = session_current();
+    if (session && session->batching && is_batchable(query)) {
+        session_defer(session, query);
+        pthread_rwlock_unlock(&db_lock);
+        st.code = OK;
+        st.message = "query batched";
+        return st;
+    }
+
+    if (modifies_db(query->type)) force_all();
+
+    if (session && plan_deferrable(query)) {
+        map_insert(query->assign_var, plan_defer(query), RESULT);
+        query->assign_var = NULL;
+        pthread_rwlock_unlock(&db_lock);
+        st.code = OK;
+        st.message = "query deferred";
+        return st;
+    }
+
+    force_operands(query);
+    flatten_operands(query);
+
     switch(query->type) {
         case(CREATE):
             st = create(query);
@@ -1076,22 +1893,56 @@ struct status execute_db_operator(db_operator *query, struct cvec ***result) {
             break;
         case(JOIN):
             //st = nl_join(query->vals1, query->pos1, query->vals2, query->pos2, &r, &r2);
-            st = simple_hash_join(query->vals1, query->pos1, query->vals2, query->pos2, &r, &r2);
+            st = join_rows(query, &r, &r2);
             (void)nl_join;
             break;
+        case(MERGE_JOIN):
+            st = join_rows(query, &r, &r2);
+            break;
+        case(SEMI_JOIN): case(ANTI_JOIN):
+            st = semi_rows(query, &r);
+            break;
+        case(STAR_JOIN):
+            st = star_rows(query);
+            break;
+        case(GROUP):
+            st = group_rows(query);
+            break;
         case(DELETE): break;
         case(UPDATE):
             st = update_col(query->select, query->columns, query->pos1);
             break;
 
-        case(MERGE_JOIN): break;
+        case(BATCH_QUERIES):
+            if (session) session->batching = true;
+            st.code = session ? OK : ERROR;
+            st.message = "batching queries";
+            break;
+        case(BATCH_EXECUTE):
+            if (session) st = batch_execute(session);
+            break;
+        case(FREE):
+            st.code = map_remove(query->assign_var) ? OK : ERROR;
+            st.message = (st.code == OK) ? "variable freed" : "no such variable";
+            free(query->assign_var);
+            break;
+
         default: break;
     }
 
     if (r != NULL) map_insert(query->assign_var, r, RESULT);
     if (r2 != NULL) map_insert(query->assign_var2, r2, RESULT);
 
+    pthread_rwlock_unlock(&db_lock);
+
     free(query);
     return st;
 }
 
+
+/* a writer forcing pending plans may be reading the session's results */
+void execute_session_end(struct session *s) {
+    pthread_rwlock_rdlock(&db_lock);
+    session_free(s);
+    pthread_rwlock_unlock(&db_lock);
+}
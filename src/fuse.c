@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "fuse.h"
+#include "simd.h"
+#include "bitmap.h"
+#include "tpool.h"
+#include "utils.h"
+
+/* values per morsel of a fused pass, a multiple of ZONE_SIZE */
+#define FUSE_MORSEL (1 << 14)
+
+/*
+ * Fused operators evaluate an aggregate straight from the columns it
+ * depends on: no position list of the select nor value vector of the fetch
+ * is materialized in between.
+ */
+
+static inline
+void acc_slice(struct agg_acc *acc, const int *vals, size_t n) {
+    long int min = acc->min, max = acc->max, sum = 0;
+    for (size_t j = 0; j < n; j++) {
+	min = (vals[j] < min) ? vals[j] : min;
+	max = (vals[j] > max) ? vals[j] : max;
+	sum += vals[j];
+    }
+    acc->min = min;
+    acc->max = max;
+    acc->sum += sum;
+    acc->count += n;
+}
+
+/* aggregates vals[base + j] for the bits j set in |bits| */
+static inline
+void acc_bits(struct agg_acc *acc, const uint64_t *bits, size_t nbits,
+	      const int *vals) {
+    for (size_t w = 0; w < BITMAP_WORDS(nbits); w++) {
+	uint64_t word = bits[w];
+	if (word == UINT64_MAX) {
+	    acc_slice(acc, vals + w * 64, 64);
+	    continue;
+	}
+	for (; word; word &= word - 1)
+	    acc_value(acc, vals[w * 64 + __builtin_ctzll(word)]);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+struct fuse_task {
+    struct scanq const *q;
+    const int *svals;
+    const int *fvals;
+    size_t base;
+    size_t len;
+    struct agg_acc acc;
+};
+
+static
+void fuse_morsel(void *arg) {
+    struct fuse_task *t = arg;
+    struct scanq const *q = t->q;
+    uint64_t bits[ZONE_SIZE / 64];
+
+    acc_init(&t->acc);
+    for (size_t off = 0; off < t->len; off += ZONE_SIZE) {
+	size_t pos = t->base + off;
+	size_t n = (t->len - off < ZONE_SIZE) ? t->len - off : ZONE_SIZE;
+	switch (sscan_zone(q, pos / ZONE_SIZE)) {
+	    case ZONE_NONE:
+		break;
+	    case ZONE_ALL:
+		acc_slice(&t->acc, t->fvals + pos, n);
+		break;
+	    case ZONE_SOME: {
+		size_t count = (q->point)
+		    ? simd_point_bits(bits, t->svals + pos, n, q->low)
+		    : simd_range_bits(bits, t->svals + pos, n, q->low, q->high);
+		if (count) acc_bits(&t->acc, bits, n, t->fvals + pos);
+		break;
+	    }
+	}
+    }
+}
+
+/*
+ * Aggregates fvals[j] for the positions j where svals[j] qualifies for |q|,
+ * zone by zone, in morsels over the execution pool.
+ */
+void fuse_select_aggregate(struct scanq const *q, const int *svals,
+			   const int *fvals, size_t sz, struct agg_acc *acc) {
+    struct tpool *tp = exec_pool();
+    size_t nm = (sz + FUSE_MORSEL - 1) / FUSE_MORSEL;
+    if (tp == NULL || nm < 2) nm = (sz) ? 1 : 0;
+
+    struct fuse_task *ts = malloc(nm * sizeof *ts);
+    assert(ts || nm == 0);
+    size_t per = (nm > 1) ? FUSE_MORSEL : sz;
+    for (size_t m = 0; m < nm; m++) {
+	ts[m].q = q;
+	ts[m].svals = svals;
+	ts[m].fvals = fvals;
+	ts[m].base = m * per;
+	ts[m].len = (m == nm - 1) ? sz - m * per : per;
+    }
+
+    tpool_run(tp, fuse_morsel, ts, nm, sizeof *ts);
+
+    acc_init(acc);
+    for (size_t m = 0; m < nm; m++)
+	acc_merge(acc, &ts[m].acc);
+    free(ts);
+    cs165_log(stderr, "fuse_select_aggregate: %zu of %zu\n", acc->count, sz);
+}
+
+/* aggregates vals at the positions |pos| without gathering them first */
+void fuse_gather_aggregate(const int *vals, struct cvec const *pos, struct agg_acc *acc) {
+    acc_init(acc);
+    switch(pos->type) {
+	case RANGE:
+	    acc_slice(acc, vals + pos->start, pos->num_tuples);
+	    break;
+	case BITMAP:
+	    acc_bits(acc, pos->bits, pos->nbits, vals);
+	    break;
+	case VECTOR:
+	    for (size_t j = 0; j < pos->num_tuples; j++)
+		acc_value(acc, vals[pos->values[j]]);
+	    break;
+	default: assert(false);
+    }
+}
@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <assert.h>
+
+#include "group.h"
+#include "cvec.h"
+#include "fuse.h"
+#include "tpool.h"
+#include "utils.h"
+
+#define GROUP_PARALLEL_MIN (1 << 16)
+/* slots of a new table, a power of two */
+#define GROUP_MIN_SLOTS 1024
+
+/*
+ * Hash group-by. Each thread groups a slice of the rows into a table of its
+ * own, so the accumulators it updates are never shared, and the partial
+ * tables are merged into the first one at the end.
+ *
+ * A table is open addressing with linear probing. A slot keeps the key next
+ * to its group, so a probe reads consecutive slots of one or two cache
+ * lines and follows no chain; the table is kept at most half full.
+ */
+
+struct group_slot {
+    long int key;
+    size_t group;               // index + 1 into the groups, 0 if empty
+};
+
+struct group_table {
+    struct group_slot *slots;
+    size_t nslots;
+    int shift;                  // 64 - log2(nslots)
+    long int *keys;             // of each group, in order of appearance
+    struct agg_acc *accs;       // nvals per group
+    size_t ngroups;
+    size_t cap;                 // groups allocated
+    size_t nvals;
+};
+
+static inline
+size_t group_hash(struct group_table const *t, long int key) {
+    return ((uint64_t) key * 0x9E3779B97F4A7C15ull) >> t->shift;
+}
+
+static inline
+long int in_value(struct group_in const *in, size_t j) {
+    return (in->wide) ? ((const long int *) in->vals)[j] : ((const int *) in->vals)[j];
+}
+
+/* (re)builds the slots of |t| from its groups */
+static
+void table_slots(struct group_table *t, size_t nslots) {
+    free(t->slots);
+    t->slots = calloc(nslots, sizeof *t->slots);
+    assert(t->slots);
+    t->nslots = nslots;
+    t->shift = 64 - __builtin_ctzll(nslots);
+    for (size_t g = 0; g < t->ngroups; g++) {
+	size_t s = group_hash(t, t->keys[g]);
+	while (t->slots[s].group) s = (s + 1) & (nslots - 1);
+	t->slots[s] = (struct group_slot) { t->keys[g], g + 1 };
+    }
+}
+
+static
+void table_init(struct group_table *t, size_t nvals) {
+    memset(t, 0, sizeof *t);
+    t->nvals = nvals;
+    t->cap = GROUP_MIN_SLOTS / 2;
+    t->keys = malloc(t->cap * sizeof *t->keys);
+    t->accs = malloc(t->cap * nvals * sizeof *t->accs);
+    assert(t->keys && (t->accs || nvals == 0));
+    table_slots(t, GROUP_MIN_SLOTS);
+}
+
+static
+void table_free(struct group_table *t) {
+    free(t->slots);
+    free(t->keys);
+    free(t->accs);
+}
+
+/* the group of |key|, added if |t| has none */
+static inline
+size_t table_group(struct group_table *t, long int key) {
+    size_t s = group_hash(t, key);
+    for (; t->slots[s].group; s = (s + 1) & (t->nslots - 1))
+	if (t->slots[s].key == key) return t->slots[s].group - 1;
+
+    if (t->ngroups == t->cap) {
+	t->cap *= 2;
+	t->keys = realloc(t->keys, t->cap * sizeof *t->keys);
+	t->accs = realloc(t->accs, t->cap * t->nvals * sizeof *t->accs);
+	assert(t->keys && (t->accs || t->nvals == 0));
+    }
+    size_t g = t->ngroups++;
+    t->keys[g] = key;
+    for (size_t v = 0; v < t->nvals; v++)
+	acc_init(&t->accs[g * t->nvals + v]);
+    t->slots[s] = (struct group_slot) { key, g + 1 };
+    if (2 * t->ngroups > t->nslots) table_slots(t, 2 * t->nslots);
+    return g;
+}
+
+static
+void table_merge(struct group_table *t, struct group_table const *part) {
+    for (size_t g = 0; g < part->ngroups; g++) {
+	size_t h = table_group(t, part->keys[g]);
+	for (size_t v = 0; v < t->nvals; v++)
+	    acc_merge(&t->accs[h * t->nvals + v], &part->accs[g * t->nvals + v]);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+struct group_task {
+    struct group_in const *keys;
+    struct group_in const *vals;
+    size_t nvals;
+    size_t off;
+    size_t len;
+    struct group_table t;
+};
+
+static
+void group_part(void *arg) {
+    struct group_task *gt = arg;
+    table_init(&gt->t, gt->nvals);
+    for (size_t j = gt->off; j < gt->off + gt->len; j++) {
+	size_t g = table_group(&gt->t, in_value(gt->keys, j));
+	struct agg_acc *acc = &gt->t.accs[g * gt->nvals];
+	for (size_t v = 0; v < gt->nvals; v++)
+	    acc_value(&acc[v], in_value(&gt->vals[v], j));
+    }
+}
+
+static
+int slot_cmp(const void *a, const void *b) {
+    long int x = ((const struct group_slot *) a)->key;
+    long int y = ((const struct group_slot *) b)->key;
+    return (x > y) - (x < y);
+}
+
+/* whether a group's sum of value input |v| does not fit a long */
+static
+bool sums_overflow(struct group_table const *t, size_t v) {
+    for (size_t g = 0; g < t->ngroups; g++) {
+	__int128 sum = t->accs[g * t->nvals + v].sum;
+	if (sum < LONG_MIN || sum > LONG_MAX) return true;
+    }
+    return false;
+}
+
+/*
+ * Aggregate |agg| of value input |v| for the groups in |order|. Sums are
+ * doubles, as averages are, once one of them does not fit a long.
+ */
+static
+struct cvec *group_result(struct group_table const *t, struct group_slot const *order,
+			  size_t v, enum aggr agg) {
+    struct cvec *r = cvec_alloc();
+    size_t ng = t->ngroups;
+    r->num_tuples = ng;
+
+    if (agg == AVG || (agg == SUM && sums_overflow(t, v))) {
+	r->type = DOUBLE_VECTOR;
+	r->double_values = malloc(ng * sizeof *r->double_values);
+	assert(r->double_values || ng == 0);
+	for (size_t j = 0; j < ng; j++) {
+	    struct agg_acc const *acc = &t->accs[order[j].group * t->nvals + v];
+	    r->double_values[j] = (agg == AVG) ? (long double) acc->sum / acc->count
+					       : (long double) acc->sum;
+	}
+	if (agg == SUM) cs165_log(stderr, "group_by: sums overflow a long\n");
+	return r;
+    }
+
+    r->type = LONG_VECTOR;
+    r->long_values = malloc(ng * sizeof *r->long_values);
+    assert(r->long_values || ng == 0);
+    for (size_t j = 0; j < ng; j++) {
+	struct agg_acc const *acc = &t->accs[order[j].group * t->nvals + v];
+	switch(agg) {
+	    case MIN: r->long_values[j] = acc->min; break;
+	    case MAX: r->long_values[j] = acc->max; break;
+	    case SUM: r->long_values[j] = acc->sum; break;
+	    case COUNT: r->long_values[j] = acc->count; break;
+	    case AVG: assert(false);
+	}
+    }
+    return r;
+}
+
+void group_by(struct group_in keys, struct group_in const *vals,
+	      enum aggr const *aggs, size_t nvals,
+	      struct cvec **rkeys, struct cvec **res) {
+    size_t n = keys.n;
+    struct tpool *tp = exec_pool();
+    size_t nt = tpool_tasks(tp, n, GROUP_PARALLEL_MIN);
+
+    struct group_task *ts = malloc(nt * sizeof *ts);
+    assert(ts);
+    for (size_t j = 0; j < nt; j++) {
+	ts[j].keys = &keys;
+	ts[j].vals = vals;
+	ts[j].nvals = nvals;
+	ts[j].off = tpool_slice(n, nt, j, &ts[j].len);
+    }
+
+    tpool_run(tp, group_part, ts, nt, sizeof *ts);
+
+    struct group_table *t = &ts[0].t;
+    for (size_t j = 1; j < nt; j++) {
+	table_merge(t, &ts[j].t);
+	table_free(&ts[j].t);
+    }
+
+    // the groups in key order
+    size_t ng = t->ngroups;
+    struct group_slot *order = malloc(ng * sizeof *order);
+    assert(order || ng == 0);
+    for (size_t g = 0; g < ng; g++)
+	order[g] = (struct group_slot) { t->keys[g], g };
+    qsort(order, ng, sizeof *order, slot_cmp);
+
+    struct cvec *rk = cvec_alloc();
+    rk->num_tuples = ng;
+    if (keys.wide) {
+	rk->type = LONG_VECTOR;
+	rk->long_values = malloc(ng * sizeof *rk->long_values);
+	assert(rk->long_values || ng == 0);
+	for (size_t j = 0; j < ng; j++) rk->long_values[j] = order[j].key;
+    } else {
+	rk->type = VECTOR;
+	rk->values = malloc(ng * sizeof *rk->values);
+	assert(rk->values || ng == 0);
+	for (size_t j = 0; j < ng; j++) rk->values[j] = order[j].key;
+    }
+    *rkeys = rk;
+    for (size_t v = 0; v < nvals; v++)
+	res[v] = group_result(t, order, v, aggs[v]);
+
+    cs165_log(stderr, "group_by: %zu groups of %zu rows\n", ng, n);
+    free(order);
+    table_free(t);
+    free(ts);
+}
@@ -0,0 +1,18 @@
+#ifndef AGGR_H
+#define AGGR_H
+
+#include <stddef.h>
+
+#include "cs165_api.h"
+
+/*
+ * Min, max and sum of |n| values of a VECTOR or LONG_VECTOR, with the SIMD
+ * kernels; large inputs are split over the execution pool. The min and max
+ * of no values are 0. The sum is 128-bit, so a sum of longs cannot
+ * overflow.
+ */
+extern long int aggr_min(const void *vals, size_t n, enum result_type type);
+extern long int aggr_max(const void *vals, size_t n, enum result_type type);
+extern __int128 aggr_sum(const void *vals, size_t n, enum result_type type);
+
+#endif
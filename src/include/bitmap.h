@@ -0,0 +1,20 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Position bitmaps: bit j of word j / 64 is set when position j qualifies.
+ * Bits past the last position are always clear.
+ */
+#define BITMAP_WORDS(nbits) (((nbits) + 63) / 64)
+
+extern uint64_t *bitmap_alloc(size_t nbits);
+extern bool bitmap_isset(const uint64_t *bits, size_t j);
+extern size_t bitmap_count(const uint64_t *bits, size_t nbits);
+extern size_t bitmap_fill(uint64_t *bits, size_t nbits);
+extern size_t bitmap_positions(int *out, const uint64_t *bits, size_t nbits);
+
+#endif
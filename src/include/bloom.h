@@ -0,0 +1,66 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "zonemap.h"
+
+/* 8 bits per value; a zone's filter is split in blocks of one cache line */
+#define BLOOM_ZONE_WORDS (ZONE_SIZE / 8)
+#define BLOOM_BLOCK_WORDS 8
+
+/**
+ * bloom
+ * A blocked Bloom filter per zone of a column, answering whether a zone may
+ * hold a value. It is optional: |words| is NULL when the column has none.
+ **/
+struct bloom {
+    size_t nzones;
+    size_t capacity;
+    uint64_t *words;
+};
+
+/* a blocked Bloom filter of a set of values, with 2^bits blocks */
+struct bloom_set {
+    int bits;
+    uint64_t *words;
+};
+
+extern void bloom_free(struct bloom *b);
+extern void bloom_build(struct bloom *b, const int *vals, size_t sz);
+extern void bloom_insert(struct bloom *b, const int *vals, size_t sz, size_t pos);
+extern void bloom_update(struct bloom *b, size_t pos, int value);
+extern bool bloom_test(const struct bloom *b, size_t zone, int value);
+extern void bloom_set_build(struct bloom_set *s, const int *vals, size_t n);
+extern void bloom_set_free(struct bloom_set *s);
+
+static inline
+uint64_t bloom_hash(int value) {
+    uint64_t h = (uint32_t) value;
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    return h;
+}
+
+static inline
+size_t bloom_set_block(const struct bloom_set *s, uint64_t h) {
+    return (s->bits) ? (h * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - s->bits) : 0;
+}
+
+/* false if |value| is certainly not in |s|; inline, as joins test every row */
+static inline
+bool bloom_set_test(const struct bloom_set *s, int value) {
+    uint64_t h = bloom_hash(value);
+    const uint64_t *block = s->words + bloom_set_block(s, h) * BLOOM_BLOCK_WORDS;
+    bool in = true;
+    for (int k = 0; k < BLOOM_BLOCK_WORDS; k++)
+	in &= block[k] >> ((h >> (6 * k)) & 63) & 1;
+    return in;
+}
+
+#endif
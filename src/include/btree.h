@@ -1,6 +1,14 @@
 #ifndef BTREE_H
 #define BTREE_H
 
+/* count, sum, min and max of keys, each counted once per id */
+struct btstats {
+    long int count;
+    long int sum;
+    int min;
+    int max;
+};
+
 struct btree {
     struct btnode *root;
     size_t size;
@@ -10,12 +18,16 @@ struct btree {
 };
 
 extern int btree_max(struct btree *bt);
+extern int btree_min(struct btree *bt);
+extern struct btstats btree_range(struct btree *bt, long int lo, long int hi);
 extern void btree_free(struct btree *bt);
 extern struct btree *btree_create(bool clustered);
 extern bool btree_init(struct btree *bt, bool clustered);
 extern void btree_load(struct btree *bt, struct vec *v);
 extern struct vec *btree_search(struct btree *bt, int k);
 extern struct vec *btree_rsearch(struct btree *bt, int lo, int hi);
+extern void btree_leaves(struct btree *bt, const int *keys, size_t n, struct btnode **leaves);
+extern size_t btree_leaf_ids(struct btnode *leaf, int k, const int **ids);
 extern void btree_update(struct btree *bt, int k, int id);
 
 extern void btree_traverse(struct btree *bt);
@@ -21,8 +21,11 @@ SOFTWARE.
 #define CS165_H
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include "vector.h"
+#include "zonemap.h"
+#include "bloom.h"
 
 /**
  * EXTRA
@@ -79,6 +82,10 @@ enum col_status { ONDISK, INMEMORY, MODIFIED };
  * - data, this is the raw data for the column. Operations on the data should
  *       be persistent.
  * - index, this is an [opt] index built on top of the column's data.
+ * - zones, the min and max of each block of the data, for scans to skip
+ *       blocks without qualifying values.
+ * - bloom, [opt] per block Bloom filters for point selects on columns
+ *       without an index.
  *
  * NOTE: We do not track the column length in the column struct since all
  * columns in a table should share the same length. Instead, this is
@@ -92,6 +99,8 @@ struct column {
     enum col_status status;
     column_index *index;
     struct vec data;
+    struct zonemap zones;
+    struct bloom bloom;
 };
 
 /**
@@ -147,16 +156,33 @@ struct status {
 
 typedef struct cvec cvec;
 
-enum result_type { VECTOR, LONG_VECTOR, DOUBLE_VAL, LONG_VAL };
+enum result_type { VECTOR, LONG_VECTOR, DOUBLE_VECTOR, DOUBLE_VAL, LONG_VAL, BITMAP, RANGE, PENDING };
 
+/*
+ * A BITMAP holds the num_tuples positions set in |bits|, out of the |nbits|
+ * positions of the column it was selected from (see bitmap.h). A RANGE holds
+ * the consecutive positions [start, end), as selected from a clustered column.
+ * A PENDING result is not computed yet: |plan| computes it (see plan.h).
+ */
 struct cvec {
     enum result_type type;
     size_t num_tuples;
+    size_t refs;                // names bound to this result (see cvec.c)
     union {
       long int *long_values;
       int *values;
+      long double *double_values;
       long int ival;
       long double dval;
+      struct {
+        uint64_t *bits;
+        size_t nbits;
+      };
+      struct {
+        size_t start;
+        size_t end;
+      };
+      struct plan *plan;
     };
 };
 
@@ -164,6 +190,8 @@ typedef enum aggr {
     MIN,
     MAX,
     AVG,
+    COUNT,
+    SUM,
 } aggr;
 
 typedef enum create {
@@ -190,10 +218,17 @@ typedef enum OperatorType {
     ADD,
     SUB,
     JOIN,
+    GROUP,
+    SEMI_JOIN,
+    ANTI_JOIN,
+    STAR_JOIN,
     CREATE,
     TUPLE,
     SYNC,
     BULK_LOAD,
+    FREE,
+    BATCH_QUERIES,
+    BATCH_EXECUTE,
 
     INVALID
 } OperatorType;
@@ -232,10 +267,12 @@ typedef struct db_operator {
     db *db;                     // current db
 
     table *tables;
-    column *columns;            // for SELECT, PROJECT,
+    column *columns;            // for SELECT, PROJECT, keys of GROUP
+    column **columns2;          // values of GROUP that are columns, else NULL
 
     char *assign_var;           // var name for symtable; almost every operator
     char *assign_var2;          // var name for symtable; joins
+    char **assign_vars;         // var names of the results of STAR_JOIN, GROUP
 
     enum create create_type;    // CREATE types only
     char *create_name;          // strduped name for CREATE types
@@ -245,6 +282,7 @@ typedef struct db_operator {
 
     enum index_type idx_type;   // Index type
     enum aggr agg;              // AGGREAGTE type
+    enum aggr *aggs;            // per value of GROUP
 
     struct {
       int low;
@@ -253,11 +291,13 @@ typedef struct db_operator {
 
     struct cvec *pos1;        // result of SELECT for SELECT2/PROJECT
     struct cvec *pos2;        // result of SELECT for SELECT2/PROJECT
-    struct cvec *vals1;       // result of PROJECT for SELECT2, ADD, SUB
+    struct cvec *vals1;       // result of PROJECT for SELECT2, ADD, SUB, GROUP
     struct cvec *vals2;       // second result for ADD/SUB
 
     struct cvec **tuple;
-    size_t tuple_count;         // number of columns for tuple to output
+    size_t tuple_count;         // number of columns for tuple to output, or
+                                // of operands of STAR_JOIN, or of values of
+                                // GROUP, which are results in tuple or NULL
 
     int *value1;                // For RELINSERT
     int select;                 // POINT_SELECT, UPDATE, DELETE
@@ -0,0 +1,13 @@
+#ifndef CSCAN_H
+#define CSCAN_H
+
+#include <stddef.h>
+
+#include "sscan.h"
+
+/* columns shorter than this are scanned privately */
+#define CSCAN_MIN_SIZE (1 << 18)
+
+extern void coop_scan(struct scanq *q, const int *vals, size_t sz);
+
+#endif
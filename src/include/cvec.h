@@ -0,0 +1,14 @@
+#ifndef CVEC_H
+#define CVEC_H
+
+#include "cs165_api.h"
+
+extern struct cvec *cvec_alloc(void);
+extern struct cvec *cvec_retain(struct cvec *cv);
+extern void cvec_release(struct cvec *cv);
+extern void cvec_free(struct cvec *cv);
+extern struct cvec *cvec_from_bits(uint64_t *bits, size_t nbits, size_t count);
+extern struct cvec *cvec_range(size_t start, size_t end);
+extern void cvec_flatten(struct cvec *cv);
+
+#endif
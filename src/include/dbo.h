@@ -17,9 +17,19 @@ extern db_operator *cmd_avg(size_t argc, const char **argv);
 extern db_operator *cmd_delete(size_t argc, const char **argv);
 extern db_operator *cmd_rel_delete(size_t argc, const char **argv);
 extern db_operator *cmd_join(size_t argc, const char **argv);
+extern db_operator *cmd_mergejoin(size_t argc, const char **argv);
+extern db_operator *cmd_semijoin(size_t argc, const char **argv);
+extern db_operator *cmd_antijoin(size_t argc, const char **argv);
+extern db_operator *cmd_starjoin(size_t argc, const char **argv);
+extern db_operator *cmd_groupby(size_t argc, const char **argv);
 extern db_operator *cmd_max(size_t argc, const char **argv);
 extern db_operator *cmd_min(size_t argc, const char **argv);
+extern db_operator *cmd_count(size_t argc, const char **argv);
+extern db_operator *cmd_sum(size_t argc, const char **argv);
 extern db_operator *cmd_sub(size_t argc, const char **argv);
 extern db_operator *cmd_update(size_t argc, const char **argv);
+extern db_operator *cmd_free(size_t argc, const char **argv);
+extern db_operator *cmd_batch_queries(size_t argc, const char **argv);
+extern db_operator *cmd_batch_execute(size_t argc, const char **argv);
 
 #endif
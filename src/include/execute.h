@@ -1,6 +1,9 @@
 #ifndef EXECUTE_H
 #define EXECUTE_H
 
+struct session;
+
 extern struct status execute_db_operator(db_operator *query, struct cvec ***r);
+extern void execute_session_end(struct session *s);
 
 #endif
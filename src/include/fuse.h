@@ -0,0 +1,51 @@
+#ifndef FUSE_H
+#define FUSE_H
+
+#include <stddef.h>
+#include <limits.h>
+
+#include "cs165_api.h"
+#include "sscan.h"
+
+/**
+ * agg_acc
+ * Running min, max, sum and count of the values an aggregate has seen.
+ * The sum has 128 bits: a pipelined add/sub yields longs.
+ **/
+struct agg_acc {
+    long int min;
+    long int max;
+    __int128 sum;
+    size_t count;
+};
+
+static inline
+void acc_init(struct agg_acc *acc) {
+    acc->min = LONG_MAX;
+    acc->max = LONG_MIN;
+    acc->sum = 0;
+    acc->count = 0;
+}
+
+static inline
+void acc_value(struct agg_acc *acc, long int v) {
+    acc->min = (v < acc->min) ? v : acc->min;
+    acc->max = (v > acc->max) ? v : acc->max;
+    acc->sum += v;
+    acc->count++;
+}
+
+static inline
+void acc_merge(struct agg_acc *acc, struct agg_acc const *part) {
+    acc->min = (part->min < acc->min) ? part->min : acc->min;
+    acc->max = (part->max > acc->max) ? part->max : acc->max;
+    acc->sum += part->sum;
+    acc->count += part->count;
+}
+
+extern void fuse_select_aggregate(struct scanq const *q, const int *svals,
+                                  const int *fvals, size_t sz, struct agg_acc *acc);
+extern void fuse_gather_aggregate(const int *vals, struct cvec const *pos,
+                                  struct agg_acc *acc);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef GROUP_H
+#define GROUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cs165_api.h"
+
+/* |n| ints of a column or VECTOR, or longs of a LONG_VECTOR */
+struct group_in {
+    const void *vals;
+    size_t n;
+    bool wide;
+};
+
+/*
+ * Groups the rows of |keys| by value and computes aggs[v] of vals[v] in
+ * each group, for the |nvals| value inputs, which have as many rows as
+ * |keys|. |rkeys| receives the distinct keys in ascending order and
+ * res[v] the aggregates in the same order: a DOUBLE_VECTOR for AVG, and
+ * for a SUM that overflows a long, a LONG_VECTOR otherwise.
+ */
+extern void group_by(struct group_in keys, struct group_in const *vals,
+                     enum aggr const *aggs, size_t nvals,
+                     struct cvec **rkeys, struct cvec **res);
+
+#endif
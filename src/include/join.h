@@ -0,0 +1,63 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cs165_api.h"
+
+/* one input of a join: |n| join values and the position each comes from */
+struct join_in {
+    const int *vals;
+    const int *pos;
+    size_t n;
+};
+
+/*
+ * The inner input of an index join: the rows of a column with a SORTED
+ * index of |sz| entries or a BTREE, of values in [lo, hi].
+ */
+struct join_index {
+    enum index_type type;
+    void *index;
+    size_t sz;
+    long int lo;
+    long int hi;
+};
+
+/*
+ * Equi-joins |l| and |r|, hashing or sort-merging. |rl| and |rr| receive
+ * the positions of every matching pair, from |l| and from |r|
+ * respectively, as VECTORs.
+ */
+extern void join_radix(struct join_in const *l, struct join_in const *r,
+                       struct cvec **rl, struct cvec **rr);
+extern void join_merge(struct join_in const *l, struct join_in const *r,
+                       struct cvec **rl, struct cvec **rr);
+
+/*
+ * The positions of |l| whose value is in |r|, or is not if |anti|, once
+ * each and in the order of |l|, in a VECTOR |res|. Only the values of |r|
+ * are read.
+ */
+extern void join_semi(struct join_in const *l, struct join_in const *r, bool anti,
+                      struct cvec **res);
+
+/*
+ * Joins a fact table with |ndims| dimensions: facts[d] holds the fact
+ * positions and their keys in dimension d, which dims[d] holds the values
+ * and positions of. res[0] receives the fact positions of every row of the
+ * result and res[d + 1] the aligned positions of dimension d, as VECTORs.
+ * False, and nothing computed, when there are too many dimensions.
+ */
+extern bool join_star(struct join_in const *facts, struct join_in const *dims, size_t ndims,
+                      struct cvec **res);
+
+/*
+ * Equi-joins |outer| with |inner| by index lookups. |rl| receives the
+ * positions of |outer| if |outer_left|, and those of |inner| otherwise.
+ */
+extern void join_index(struct join_in const *outer, struct join_index const *inner,
+                       bool outer_left, struct cvec **rl, struct cvec **rr);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <stddef.h>
+
+#include "cs165_api.h"
+#include "sscan.h"
+#include "fuse.h"
+
+/* values each stage hands to the next, a divisor of ZONE_SIZE */
+#define PIPE_VECTOR 1024
+#define PIPE_MAX_EXPRS 8
+#define PIPE_MAX_FILTERS 4
+
+/**
+ * pipe_expr
+ * The values of a pipeline at the positions it produces.
+ * - PIPE_FETCH, vals[pos] of a column
+ * - PIPE_ADD, PIPE_SUB, left + right and left - right
+ **/
+enum pipe_op {
+    PIPE_FETCH,
+    PIPE_ADD,
+    PIPE_SUB,
+};
+
+struct pipe_expr {
+    enum pipe_op op;
+    const int *vals;
+    struct pipe_expr *left;
+    struct pipe_expr *right;
+};
+
+/* keeps the positions whose |expr| is in [low, high) */
+struct pipe_filter {
+    struct pipe_expr *expr;
+    int low;
+    int high;
+};
+
+/**
+ * pipe
+ * Selects, fetches, select2s and add/subs evaluated a vector of PIPE_VECTOR
+ * positions at a time, so none of them materializes its result.
+ * - the positions come from scanning |svals| (size |sz|) with |q|, or from
+ *   |pos| when it is set, a computed VECTOR, BITMAP or RANGE
+ * - filters, applied in order to each vector of positions
+ * - out, the values produced, or NULL to produce the positions
+ **/
+struct pipe {
+    struct scanq q;
+    const int *svals;
+    size_t sz;
+    struct cvec const *pos;
+
+    struct pipe_filter filters[PIPE_MAX_FILTERS];
+    size_t nfilters;
+    struct pipe_expr exprs[PIPE_MAX_EXPRS];
+    size_t nexprs;
+    struct pipe_expr *out;
+};
+
+extern void pipe_init(struct pipe *p);
+extern struct pipe_expr *pipe_node(struct pipe *p, enum pipe_op op);
+extern bool pipe_filter(struct pipe *p, struct pipe_expr *expr, int low, int high);
+extern void pipe_aggregate(struct pipe const *p, struct agg_acc *acc);
+extern struct cvec *pipe_collect(struct pipe const *p);
+
+#endif
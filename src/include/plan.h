@@ -0,0 +1,29 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include "cs165_api.h"
+
+/**
+ * plan
+ * An operator whose execution is deferred until its result is needed.
+ * - op, the operator; it no longer owns assign_var, bound to |result|
+ * - result, a PENDING cvec that forcing the plan fills in place
+ * - unpiped, set once the plan failed to pipeline, not to try it again
+ *
+ * A plan retains the results it reads, so rebinding their names does not
+ * free them before the plan is forced or dropped.
+ **/
+struct plan {
+    db_operator *op;
+    struct cvec *result;
+    bool unpiped;
+    struct plan *prev;
+    struct plan *next;
+};
+
+extern bool plan_deferrable(db_operator *op);
+extern struct cvec *plan_defer(db_operator *op);
+extern struct plan *plan_first(void);
+extern void plan_free(struct plan *p);
+
+#endif
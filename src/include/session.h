@@ -0,0 +1,27 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "cs165_api.h"
+
+/**
+ * session
+ * State of one connected client that outlives a single query.
+ * - vars, the results bound by this client (see symtable.c)
+ * - batching, set between batch_queries() and batch_execute()
+ * - batch, the selects deferred until batch_execute()
+ **/
+struct session {
+    struct symtable *vars;
+    bool batching;
+    size_t batch_sz;
+    size_t batch_capacity;
+    db_operator **batch;
+};
+
+extern struct session *session_create(void);
+extern void session_free(struct session *s);
+extern void session_enter(struct session *s);
+extern struct session *session_current(void);
+extern void session_defer(struct session *s, db_operator *query);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Selection kernels. Each writes the qualifying positions to |out|, which
+ * must have room for |n| of them, and returns how many there are.
+ * - simd_range, positions base + j with low <= vals[j] < high
+ * - simd_point, positions base + j with vals[j] == value
+ * - simd_range_pos, pos[j] with low <= vals[j] < high
+ *
+ * The _bits variants set bit j of |bits| instead, writing every word that
+ * covers the |n| values, and return the number of bits set.
+ */
+extern size_t simd_range(int *out, const int *vals, size_t n, int low, int high, int base);
+extern size_t simd_point(int *out, const int *vals, size_t n, int value, int base);
+extern size_t simd_range_pos(int *out, const int *pos, const int *vals, size_t n,
+                             int low, int high);
+extern size_t simd_range_bits(uint64_t *bits, const int *vals, size_t n, int low, int high);
+extern size_t simd_point_bits(uint64_t *bits, const int *vals, size_t n, int value);
+
+/*
+ * Aggregation kernels over n > 0 ints, or longs for the _long variants.
+ * Sums of ints are 64-bit, exact for fewer than 2^32 values; sums of longs
+ * are 128-bit and do not overflow.
+ */
+extern int simd_min(const int *vals, size_t n);
+extern int simd_max(const int *vals, size_t n);
+extern long int simd_sum(const int *vals, size_t n);
+extern long int simd_min_long(const long int *vals, size_t n);
+extern long int simd_max_long(const long int *vals, size_t n);
+extern __int128 simd_sum_long(const long int *vals, size_t n);
+
+#endif
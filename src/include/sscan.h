@@ -0,0 +1,38 @@
+#ifndef SSCAN_H
+#define SSCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "zonemap.h"
+#include "bloom.h"
+
+/**
+ * scanq
+ * One select evaluated by a shared scan.
+ * - point, equality on |low| instead of the range [low, high)
+ * - bits, one bit per value of the column, allocated by the caller with
+ *   bitmap_alloc(); the scan writes every word
+ * - zones, the zone map of the column or NULL; blocks whose zone rules
+ *   them all in or out are not read
+ * - bloom, the Bloom filters of the column or NULL, for point selects
+ * - num_tuples, the number of qualifying positions
+ **/
+struct scanq {
+    int low;
+    int high;
+    bool point;
+    uint64_t *bits;
+    const struct zone *zones;
+    const struct bloom *bloom;
+    size_t num_tuples;
+};
+
+extern enum zone_match sscan_zone(struct scanq const *q, size_t zone);
+extern size_t sscan_block(struct scanq *q, const int *vals, size_t base, size_t len);
+extern void morsel_scan(struct scanq *const *qs, size_t nq, const int *vals,
+                        size_t base, size_t len);
+extern void shared_scan(struct scanq *qs, size_t nq, const int *vals, size_t sz);
+
+#endif
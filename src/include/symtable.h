@@ -5,9 +5,16 @@
 
 enum vartype { INVALID_VARTYPE, ENTITY, RESULT };
 
+struct symtable;
+
+extern struct symtable *symtable_create(void);
+extern void symtable_free(struct symtable *st);
+extern void map_set_scope(struct symtable *st);
+
 extern enum vartype map_gettype(const char *var);
 extern void *map_get(const char *var);
 extern bool map_insert(char *var, void *value, enum vartype type);
+extern bool map_remove(const char *var);
 extern void clean_symtbl(void);
 
 #endif
@@ -0,0 +1,22 @@
+#ifndef TPOOL_H
+#define TPOOL_H
+
+#include <stddef.h>
+
+typedef void (*tpool_fn)(void *arg);
+
+struct tpool;
+
+extern struct tpool *tpool_create(size_t nthreads);
+extern void tpool_destroy(struct tpool *tp);
+extern void tpool_submit(struct tpool *tp, tpool_fn fn, void *arg);
+extern size_t tpool_size(struct tpool *tp);
+extern void tpool_run(struct tpool *tp, tpool_fn fn, void *tasks, size_t n, size_t tasksz);
+extern size_t tpool_tasks(struct tpool *tp, size_t n, size_t min);
+extern size_t tpool_slice(size_t n, size_t nt, size_t t, size_t *len);
+
+extern struct tpool *exec_pool(void);
+
+extern size_t num_cores(void);
+
+#endif
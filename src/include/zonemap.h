@@ -0,0 +1,48 @@
+#ifndef ZONEMAP_H
+#define ZONEMAP_H
+
+#include <stddef.h>
+
+/* values per zone: a multiple of 64, so a zone covers whole bitmap words */
+#define ZONE_SIZE 4096
+
+struct zone {
+    int min;
+    int max;
+};
+
+/**
+ * zonemap
+ * The min and max of every ZONE_SIZE consecutive values of a column. The
+ * bounds may be wider than the values after updates, never narrower.
+ **/
+struct zonemap {
+    size_t nzones;
+    size_t capacity;
+    struct zone *zones;
+};
+
+/* how many values of a zone qualify for a predicate */
+enum zone_match { ZONE_NONE, ZONE_SOME, ZONE_ALL };
+
+static inline
+enum zone_match zone_range(const struct zone *z, int low, int high) {
+    if (z->max < low || z->min >= high) return ZONE_NONE;
+    if (z->min >= low && z->max < high) return ZONE_ALL;
+    return ZONE_SOME;
+}
+
+static inline
+enum zone_match zone_point(const struct zone *z, int value) {
+    if (value < z->min || value > z->max) return ZONE_NONE;
+    if (z->min == value && z->max == value) return ZONE_ALL;
+    return ZONE_SOME;
+}
+
+extern void zonemap_init(struct zonemap *zm);
+extern void zonemap_free(struct zonemap *zm);
+extern void zonemap_build(struct zonemap *zm, const int *vals, size_t sz);
+extern void zonemap_insert(struct zonemap *zm, const int *vals, size_t sz, size_t pos);
+extern void zonemap_update(struct zonemap *zm, size_t pos, int value);
+
+#endif
@@ -0,0 +1,788 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "join.h"
+#include "cvec.h"
+#include "tpool.h"
+#include "bloom.h"
+#include "btree.h"
+#include "sindex.h"
+#include "utils.h"
+
+/* build tuples per partition: its table, twice as many slots, stays in L2 */
+#define JOIN_PART_TUPLES (1 << 13)
+/* partitions are written in one pass: more would thrash the TLB */
+#define JOIN_MAX_BITS 12
+#define JOIN_PARALLEL_MIN (1 << 16)
+/* runs of partitions a parallel join hands each thread, to even out skew */
+#define JOIN_PARTS_PER_TASK 4
+/* probe rows tested against the build filter to see if filtering pays */
+#define JOIN_BLOOM_SAMPLE 1024
+/* the most dimensions a star join probes */
+#define JOIN_STAR_MAX_DIMS 8
+/* index lookups in flight at once */
+#define JOIN_PROBE_BATCH 16
+
+/*
+ * Radix join. Both inputs are scattered by the top bits of the hash of
+ * their values into partitions small enough that a hash table of the
+ * smaller input's partition fits in cache, and each partition is then
+ * joined on its own: every probe hits cache instead of memory.
+ *
+ * The table of a partition is open addressing with linear probing. Equal
+ * values take consecutive slots of one run, so a probe reads the run up to
+ * the first empty slot and emits every match in it.
+ */
+
+struct join_tuple {
+    int val;
+    int pos;                    // -1 marks an empty slot
+};
+
+/* the positions of the matching pairs */
+struct join_out {
+    int *left;
+    int *right;
+    size_t n;
+    size_t cap;
+};
+
+static inline
+uint64_t join_hash(int v) {
+    return (uint32_t) v * 0x9E3779B97F4A7C15ull;
+}
+
+static inline
+size_t join_part(uint64_t h, int bits) {
+    return (bits) ? h >> (64 - bits) : 0;
+}
+
+static inline
+void out_push(struct join_out *o, int l, int r) {
+    if (o->n == o->cap) {
+	o->cap = (o->cap) ? 2 * o->cap : 1024;
+	o->left = realloc(o->left, o->cap * sizeof *o->left);
+	o->right = realloc(o->right, o->cap * sizeof *o->right);
+	assert(o->left && o->right);
+    }
+    o->left[o->n] = l;
+    o->right[o->n] = r;
+    o->n++;
+}
+
+static
+struct cvec *out_vector(int *vals, size_t n) {
+    struct cvec *cv = cvec_alloc();
+    cv->values = realloc(vals, n * sizeof *vals);
+    cv->num_tuples = n;
+    cv->type = VECTOR;
+    return cv;
+}
+
+struct scatter_task {
+    struct join_in const *in;
+    size_t off;
+    size_t len;
+    int bits;
+    size_t *cursor;             // per partition: its count, then where to write
+    struct join_tuple *out;
+};
+
+static
+void scatter_count(void *arg) {
+    struct scatter_task *t = arg;
+    memset(t->cursor, 0, ((size_t) 1 << t->bits) * sizeof *t->cursor);
+    for (size_t j = t->off; j < t->off + t->len; j++)
+	t->cursor[join_part(join_hash(t->in->vals[j]), t->bits)]++;
+}
+
+static
+void scatter_copy(void *arg) {
+    struct scatter_task *t = arg;
+    for (size_t j = t->off; j < t->off + t->len; j++) {
+	size_t p = join_part(join_hash(t->in->vals[j]), t->bits);
+	t->out[t->cursor[p]++] = (struct join_tuple) { t->in->vals[j], t->in->pos[j] };
+    }
+}
+
+/*
+ * Scatters |in| into 2^bits partitions; partition p is [off[p], off[p + 1]).
+ * Each of the |nt| tasks counts its slice of the input, then writes it to
+ * its own stretch of every partition.
+ */
+static
+struct join_tuple *partition(struct tpool *tp, size_t nt, struct join_in const *in,
+			     int bits, size_t *off) {
+    size_t np = (size_t) 1 << bits;
+    struct join_tuple *out = malloc(in->n * sizeof *out);
+    struct scatter_task *ts = malloc(nt * sizeof *ts);
+    size_t *cursors = malloc(nt * np * sizeof *cursors);
+    assert((out || in->n == 0) && ts && cursors);
+
+    for (size_t t = 0; t < nt; t++) {
+	size_t len, o = tpool_slice(in->n, nt, t, &len);
+	ts[t] = (struct scatter_task) { in, o, len, bits, cursors + t * np, out };
+    }
+    tpool_run(tp, scatter_count, ts, nt, sizeof *ts);
+
+    size_t sum = 0;
+    for (size_t p = 0; p < np; p++) {
+	off[p] = sum;
+	for (size_t t = 0; t < nt; t++) {
+	    size_t count = ts[t].cursor[p];
+	    ts[t].cursor[p] = sum;
+	    sum += count;
+	}
+    }
+    off[np] = sum;
+    tpool_run(tp, scatter_copy, ts, nt, sizeof *ts);
+
+    free(cursors);
+    free(ts);
+    return out;
+}
+
+/* slots of the table of a partition of |nb| build tuples */
+static inline
+size_t part_slots(size_t nb) {
+    size_t n = 2;
+    while (n < 2 * nb) n *= 2;
+    return (nb) ? n : 0;
+}
+
+/* the slot of |v|, from the hash bits below those of the partition */
+static inline
+size_t part_slot(int v, int bits, size_t nslots) {
+    return (join_hash(v) << bits) >> (64 - __builtin_ctzll(nslots));
+}
+
+static
+void part_build(struct join_tuple const *build, size_t nb, int bits,
+		struct join_tuple *slots, size_t nslots) {
+    memset(slots, 0xff, nslots * sizeof *slots);
+    for (size_t j = 0; j < nb; j++) {
+	size_t s = part_slot(build[j].val, bits, nslots);
+	while (slots[s].pos != -1) s = (s + 1) & (nslots - 1);
+	slots[s] = build[j];
+    }
+}
+
+/*
+ * The matches of |probe| in the table of a partition, written to |left|
+ * and |right| unless they are NULL, when they are only counted.
+ */
+static inline
+size_t part_probe(struct join_tuple const *slots, size_t nslots,
+		  struct join_tuple const *probe, size_t np, int bits,
+		  bool build_left, int *left, int *right) {
+    size_t k = 0;
+    for (size_t j = 0; j < np; j++) {
+	int v = probe[j].val;
+	for (size_t s = part_slot(v, bits, nslots); slots[s].pos != -1; s = (s + 1) & (nslots - 1)) {
+	    if (slots[s].val != v) continue;
+	    if (left) {
+		left[k] = (build_left) ? slots[s].pos : probe[j].pos;
+		right[k] = (build_left) ? probe[j].pos : slots[s].pos;
+	    }
+	    k++;
+	}
+    }
+    return k;
+}
+
+struct probe_task {
+    struct join_tuple const *bt;
+    struct join_tuple const *pt;
+    size_t const *boff;         // build, probe and slot offsets per partition
+    size_t const *poff;
+    size_t const *soff;
+    struct join_tuple *slots;   // the tables of all partitions
+    size_t *counts;             // matches per partition
+    int *left;                  // the result, from the offsets in |counts|
+    int *right;
+    size_t first;               // partitions [first, last)
+    size_t last;
+    int bits;
+    bool build_left;
+};
+
+/* the first pass: builds the tables of a run of partitions and counts matches */
+static
+void count_parts(void *arg) {
+    struct probe_task *t = arg;
+    for (size_t k = t->first; k < t->last; k++) {
+	size_t nb = t->boff[k + 1] - t->boff[k], np = t->poff[k + 1] - t->poff[k];
+	size_t nslots = t->soff[k + 1] - t->soff[k];
+	t->counts[k] = 0;
+	if (nb == 0 || np == 0) continue;
+	part_build(t->bt + t->boff[k], nb, t->bits, t->slots + t->soff[k], nslots);
+	t->counts[k] = part_probe(t->slots + t->soff[k], nslots, t->pt + t->poff[k], np,
+				  t->bits, t->build_left, NULL, NULL);
+    }
+}
+
+/* the second pass: writes the matches of a run of partitions in place */
+static
+void write_parts(void *arg) {
+    struct probe_task *t = arg;
+    for (size_t k = t->first; k < t->last; k++) {
+	if (t->counts[k + 1] == t->counts[k]) continue;
+	part_probe(t->slots + t->soff[k], t->soff[k + 1] - t->soff[k],
+		   t->pt + t->poff[k], t->poff[k + 1] - t->poff[k], t->bits,
+		   t->build_left, t->left + t->counts[k], t->right + t->counts[k]);
+    }
+}
+
+/*
+ * The rows of one thread of a filtering pass: it keeps |n| of the |len|
+ * rows from |off| on, compacted in place from |off| on. The first member
+ * of the tasks filter_slices() runs.
+ */
+struct slice {
+    size_t off;
+    size_t len;
+    size_t n;
+};
+
+/*
+ * Runs |fn| on the |nt| tasks of |tasksz| bytes at |tasks|, each given a
+ * slice of |n| rows, then moves the rows the slices kept together in each
+ * of the |ncols| arrays of |cols|. Returns the number of rows kept, which
+ * stay in input order.
+ */
+static
+size_t filter_slices(struct tpool *tp, size_t nt, tpool_fn fn, void *tasks, size_t tasksz,
+		     size_t n, int *const *cols, size_t ncols) {
+    for (size_t t = 0; t < nt; t++) {
+	struct slice *s = (struct slice *) ((char *) tasks + t * tasksz);
+	s->off = tpool_slice(n, nt, t, &s->len);
+	s->n = 0;
+    }
+    tpool_run(tp, fn, tasks, nt, tasksz);
+
+    size_t k = 0;
+    for (size_t t = 0; t < nt; t++) {
+	struct slice const *s = (struct slice *) ((char *) tasks + t * tasksz);
+	if (k != s->off)
+	    for (size_t c = 0; c < ncols; c++)
+		memmove(cols[c] + k, cols[c] + s->off, s->n * sizeof *cols[c]);
+	k += s->n;
+    }
+    return k;
+}
+
+struct filter_task {
+    struct slice s;
+    struct join_in const *in;
+    struct bloom_set const *f;
+    int *vals;
+    int *pos;
+};
+
+static
+void filter_slice(void *arg) {
+    struct filter_task *t = arg;
+    size_t k = t->s.off;
+    for (size_t j = t->s.off; j < t->s.off + t->s.len; j++) {
+	int v = t->in->vals[j];
+	t->vals[k] = v;
+	t->pos[k] = t->in->pos[j];
+	k += bloom_set_test(t->f, v);
+    }
+    t->s.n = k - t->s.off;
+}
+
+/*
+ * The rows of |p| that may match the build side, whose filter is |f|, in
+ * |vals| and |pos|; false, and nothing allocated, when a sample of |p|
+ * shows that too few rows would be dropped to pay for the pass.
+ */
+static
+bool join_prefilter(struct tpool *tp, size_t nt, struct join_in const *p,
+		    struct bloom_set const *f, int **vals, int **pos, size_t *n) {
+    size_t sample = (p->n < JOIN_BLOOM_SAMPLE) ? p->n : JOIN_BLOOM_SAMPLE, hits = 0;
+    for (size_t j = 0; j < sample; j++)
+	hits += bloom_set_test(f, p->vals[j * (p->n / sample)]);
+    if (sample == 0 || 2 * hits > sample) return false;
+
+    *vals = malloc(p->n * sizeof **vals);
+    *pos = malloc(p->n * sizeof **pos);
+    assert(*vals && *pos);
+    struct filter_task *ts = malloc(nt * sizeof *ts);
+    assert(ts);
+    for (size_t t = 0; t < nt; t++)
+	ts[t] = (struct filter_task) { .in = p, .f = f, .vals = *vals, .pos = *pos };
+    int *cols[] = { *vals, *pos };
+    *n = filter_slices(tp, nt, filter_slice, ts, sizeof *ts, p->n, cols, 2);
+    free(ts);
+    cs165_log(stderr, "join_prefilter: %zu of %zu probe rows\n", *n, p->n);
+    return true;
+}
+
+/*
+ * Partitions and joins are split over the execution pool: the threads
+ * scatter slices of the inputs, then take runs of partitions from a shared
+ * counter. Matches are counted per partition first, so the result is
+ * allocated once at its exact size and each partition writes its matches
+ * in place, in partition order, with no buffer grown or copied. A parallel
+ * join makes enough partitions for every thread to get several.
+ */
+void join_radix(struct join_in const *l, struct join_in const *r,
+		struct cvec **rl, struct cvec **rr) {
+    bool build_left = l->n <= r->n;
+    struct join_in const *b = (build_left) ? l : r;
+    struct join_in const *p = (build_left) ? r : l;
+
+    struct tpool *tp = exec_pool();
+    size_t nt = tpool_tasks(tp, l->n + r->n, JOIN_PARALLEL_MIN);
+    size_t ntasks = (nt > 1) ? JOIN_PARTS_PER_TASK * nt : 1;
+
+    // rows of the probe side that cannot match are dropped before they are
+    // partitioned
+    struct bloom_set f;
+    struct join_in fp;
+    int *fvals = NULL, *fpos = NULL;
+    bloom_set_build(&f, b->vals, b->n);
+    if (join_prefilter(tp, nt, p, &f, &fvals, &fpos, &fp.n)) {
+	fp.vals = fvals;
+	fp.pos = fpos;
+	p = &fp;
+    }
+    bloom_set_free(&f);
+
+    int bits = 0;
+    while (bits < JOIN_MAX_BITS
+	   && ((b->n >> bits) > JOIN_PART_TUPLES || ((size_t) 1 << bits) < ntasks))
+	bits++;
+    size_t nparts = (size_t) 1 << bits;
+
+    size_t *boff = malloc((nparts + 1) * sizeof *boff);
+    size_t *poff = malloc((nparts + 1) * sizeof *poff);
+    assert(boff && poff);
+    struct join_tuple *bt = partition(tp, nt, b, bits, boff);
+    struct join_tuple *pt = partition(tp, nt, p, bits, poff);
+
+    // the table of every partition, built once for both passes
+    size_t *soff = malloc((nparts + 1) * sizeof *soff);
+    size_t *counts = malloc((nparts + 1) * sizeof *counts);
+    assert(soff && counts);
+    soff[0] = 0;
+    for (size_t k = 0; k < nparts; k++)
+	soff[k + 1] = soff[k] + part_slots(boff[k + 1] - boff[k]);
+    struct join_tuple *slots = malloc(soff[nparts] * sizeof *slots);
+    assert(slots || soff[nparts] == 0);
+
+    if (ntasks > nparts) ntasks = nparts;
+    struct probe_task *ts = malloc(ntasks * sizeof *ts);
+    assert(ts);
+    for (size_t t = 0; t < ntasks; t++)
+	ts[t] = (struct probe_task) { bt, pt, boff, poff, soff, slots, counts, NULL, NULL,
+				      t * nparts / ntasks, (t + 1) * nparts / ntasks,
+				      bits, build_left };
+    tpool_run(tp, count_parts, ts, ntasks, sizeof *ts);
+
+    // counts become the offset of each partition's matches in the result
+    size_t n = 0;
+    for (size_t k = 0; k <= nparts; k++) {
+	size_t c = (k < nparts) ? counts[k] : 0;
+	counts[k] = n;
+	n += c;
+    }
+    int *left = malloc(n * sizeof *left);
+    int *right = malloc(n * sizeof *right);
+    assert((left && right) || n == 0);
+    for (size_t t = 0; t < ntasks; t++) {
+	ts[t].left = left;
+	ts[t].right = right;
+    }
+    tpool_run(tp, write_parts, ts, ntasks, sizeof *ts);
+
+    free(ts);
+    free(slots);
+    free(soff);
+    free(counts);
+    free(bt);
+    free(pt);
+    free(boff);
+    free(poff);
+    free(fvals);
+    free(fpos);
+
+    *rl = out_vector(left, n);
+    *rr = out_vector(right, n);
+    cs165_log(stderr, "join_radix: %zu pairs, %zu partitions, %zu threads\n", n, nparts, nt);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Sort-merge join. An input already in order of value, as fetched from a
+// clustered column, is merged as it is; any other is radix sorted first.
+
+static inline
+bool join_sorted(struct join_in const *in) {
+    for (size_t j = 1; j < in->n; j++)
+	if (in->vals[j - 1] > in->vals[j]) return false;
+    return true;
+}
+
+/* the byte |d| of |v|, in an order where negative values come first */
+static inline
+size_t join_digit(int v, int d) {
+    return (((uint32_t) v ^ 0x80000000u) >> (8 * d)) & 0xff;
+}
+
+/*
+ * |in| as tuples in ascending order of value: an LSD radix sort, one pass
+ * per byte, which skips the bytes all values share. The sort keys on the
+ * value alone; being stable, it keeps equal values in input order.
+ */
+static
+struct join_tuple *sort_tuples(struct join_in const *in, bool sorted) {
+    size_t n = in->n;
+    struct join_tuple *a = malloc(n * sizeof *a);
+    assert(a || n == 0);
+    for (size_t j = 0; j < n; j++)
+	a[j] = (struct join_tuple) { in->vals[j], in->pos[j] };
+    if (sorted || n < 2) return a;
+
+    size_t hist[4][256] = { { 0 } };
+    for (size_t j = 0; j < n; j++)
+	for (int d = 0; d < 4; d++)
+	    hist[d][join_digit(a[j].val, d)]++;
+
+    struct join_tuple *tmp = malloc(n * sizeof *tmp);
+    assert(tmp);
+    for (int d = 0; d < 4; d++) {
+	if (hist[d][join_digit(a[0].val, d)] == n) continue;
+	size_t off[256], sum = 0;
+	for (size_t k = 0; k < 256; k++) {
+	    off[k] = sum;
+	    sum += hist[d][k];
+	}
+	for (size_t j = 0; j < n; j++)
+	    tmp[off[join_digit(a[j].val, d)]++] = a[j];
+	struct join_tuple *t = a;
+	a = tmp;
+	tmp = t;
+    }
+    free(tmp);
+    return a;
+}
+
+/*
+ * The pairs of matching tuples of sorted |a| and |b|, written to |left| and
+ * |right| unless they are NULL, when they are only counted.
+ */
+static
+size_t merge_runs(struct join_tuple const *a, size_t na,
+		  struct join_tuple const *b, size_t nb, int *left, int *right) {
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+	if (a[i].val < b[j].val) {
+	    i++;
+	} else if (a[i].val > b[j].val) {
+	    j++;
+	} else {
+	    // every pair of the runs of equal values matches
+	    int v = a[i].val;
+	    size_t iend = i, jend = j;
+	    while (iend < na && a[iend].val == v) iend++;
+	    while (jend < nb && b[jend].val == v) jend++;
+	    if (left) {
+		for (size_t x = i; x < iend; x++)
+		    for (size_t y = j; y < jend; y++, k++) {
+			left[k] = a[x].pos;
+			right[k] = b[y].pos;
+		    }
+	    } else {
+		k += (iend - i) * (jend - j);
+	    }
+	    i = iend;
+	    j = jend;
+	}
+    }
+    return k;
+}
+
+/* the merge runs twice, to size the result and then to fill it */
+void join_merge(struct join_in const *l, struct join_in const *r,
+		struct cvec **rl, struct cvec **rr) {
+    bool lsorted = join_sorted(l), rsorted = join_sorted(r);
+    struct join_tuple *a = sort_tuples(l, lsorted);
+    struct join_tuple *b = sort_tuples(r, rsorted);
+
+    size_t n = merge_runs(a, l->n, b, r->n, NULL, NULL);
+    int *left = malloc(n * sizeof *left);
+    int *right = malloc(n * sizeof *right);
+    assert((left && right) || n == 0);
+    merge_runs(a, l->n, b, r->n, left, right);
+    free(a);
+    free(b);
+
+    *rl = out_vector(left, n);
+    *rr = out_vector(right, n);
+    cs165_log(stderr, "join_merge: %zu pairs, sorted %d %d\n", n, lsorted, rsorted);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Index nested-loop join: each outer value is looked up in the index of the
+// inner column, a batch of lookups at a time, and the inner side is never
+// read as a whole.
+
+void join_index(struct join_in const *outer, struct join_index const *inner,
+		bool outer_left, struct cvec **rl, struct cvec **rr) {
+    struct join_out o = { NULL, NULL, 0, 0 };
+    int keys[JOIN_PROBE_BATCH], kpos[JOIN_PROBE_BATCH];
+    size_t first[JOIN_PROBE_BATCH];
+    struct btnode *leaves[JOIN_PROBE_BATCH];
+    struct sindex const *idx = inner->index;
+
+    for (size_t off = 0; off < outer->n; off += JOIN_PROBE_BATCH) {
+	size_t end = (outer->n - off < JOIN_PROBE_BATCH) ? outer->n : off + JOIN_PROBE_BATCH;
+	size_t k = 0;
+	for (size_t j = off; j < end; j++) {
+	    keys[k] = outer->vals[j];
+	    kpos[k] = outer->pos[j];
+	    k += (keys[k] >= inner->lo && keys[k] <= inner->hi);
+	}
+
+	if (inner->type == SORTED) {
+	    sindex_lower_batch(idx, inner->sz, keys, k, first);
+	    for (size_t b = 0; b < k; b++)
+		for (size_t e = first[b]; e < inner->sz && idx[e].val == keys[b]; e++)
+		    out_push(&o, kpos[b], idx[e].pos);
+	} else {
+	    btree_leaves(inner->index, keys, k, leaves);
+	    for (size_t b = 0; b < k; b++) {
+		const int *ids;
+		size_t m = btree_leaf_ids(leaves[b], keys[b], &ids);
+		for (size_t e = 0; e < m; e++)
+		    out_push(&o, kpos[b], ids[e]);
+	    }
+	}
+    }
+
+    struct cvec *ro = out_vector(o.left, o.n), *ri = out_vector(o.right, o.n);
+    *rl = (outer_left) ? ro : ri;
+    *rr = (outer_left) ? ri : ro;
+    cs165_log(stderr, "join_index: %zu pairs of %zu outer rows\n", o.n, outer->n);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Semi- and anti-joins: the rows of |l| are tested against a table of the
+// distinct values of |r|, so a probe stops at its first match and a row is
+// kept once however many rows of |r| it matches.
+
+struct semi_task {
+    struct slice s;
+    struct join_in const *in;
+    struct join_tuple const *slots;
+    size_t nslots;
+    bool anti;
+    int *out;
+};
+
+static
+void semi_slice(void *arg) {
+    struct semi_task *t = arg;
+    size_t k = t->s.off;
+    for (size_t j = t->s.off; j < t->s.off + t->s.len; j++) {
+	int v = t->in->vals[j];
+	bool found = false;
+	for (size_t s = part_slot(v, 0, t->nslots); t->slots[s].pos != -1; s = (s + 1) & (t->nslots - 1)) {
+	    if (t->slots[s].val == v) {
+		found = true;
+		break;
+	    }
+	}
+	t->out[k] = t->in->pos[j];
+	k += found != t->anti;
+    }
+    t->s.n = k - t->s.off;
+}
+
+/* |l| is probed in slices over the execution pool */
+void join_semi(struct join_in const *l, struct join_in const *r, bool anti,
+	       struct cvec **res) {
+    size_t nslots = (r->n) ? part_slots(r->n) : 2;
+    struct join_tuple *slots = malloc(nslots * sizeof *slots);
+    assert(slots);
+    memset(slots, 0xff, nslots * sizeof *slots);
+    size_t distinct = 0;
+    for (size_t j = 0; j < r->n; j++) {
+	int v = r->vals[j];
+	size_t s = part_slot(v, 0, nslots);
+	while (slots[s].pos != -1 && slots[s].val != v) s = (s + 1) & (nslots - 1);
+	if (slots[s].pos != -1) continue;
+	slots[s] = (struct join_tuple) { v, 0 };
+	distinct++;
+    }
+
+    struct tpool *tp = exec_pool();
+    size_t nt = tpool_tasks(tp, l->n, JOIN_PARALLEL_MIN);
+    int *out = malloc(l->n * sizeof *out);
+    struct semi_task *ts = malloc(nt * sizeof *ts);
+    assert((out || l->n == 0) && ts);
+    for (size_t t = 0; t < nt; t++)
+	ts[t] = (struct semi_task) { .in = l, .slots = slots, .nslots = nslots,
+				     .anti = anti, .out = out };
+    size_t k = filter_slices(tp, nt, semi_slice, ts, sizeof *ts, l->n, &out, 1);
+    free(ts);
+    free(slots);
+
+    *res = out_vector(out, k);
+    cs165_log(stderr, "join_semi: %zu of %zu rows, %zu distinct keys, anti %d\n",
+	      k, l->n, distinct, anti);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Star join: a table is built on each dimension and every fact row probes
+// all of them in one pass, stopping at the first dimension it has no match
+// in. The dimension with the fewest distinct keys is probed first, as the
+// one most likely to drop a row. A key may have several positions in a
+// dimension; the fact row then yields the product of its matches.
+
+/* the distinct keys of a dimension, each with a run of its positions */
+struct star_dim {
+    struct join_tuple *slots;   // the key and the index of its run
+    size_t nslots;
+    size_t *runs;               // run k is pos[runs[k], runs[k + 1])
+    int *pos;
+    size_t nkeys;
+};
+
+/* the slot of |v| in |d|, empty if it has none */
+static inline
+size_t star_slot(struct star_dim const *d, int v) {
+    size_t s = part_slot(v, 0, d->nslots);
+    while (d->slots[s].pos != -1 && d->slots[s].val != v) s = (s + 1) & (d->nslots - 1);
+    return s;
+}
+
+static
+void star_build(struct star_dim *d, struct join_in const *in) {
+    d->nslots = (in->n) ? part_slots(in->n) : 2;
+    d->slots = malloc(d->nslots * sizeof *d->slots);
+    d->runs = calloc(in->n + 1, sizeof *d->runs);
+    d->pos = malloc(in->n * sizeof *d->pos);
+    assert(d->slots && d->runs && (d->pos || in->n == 0));
+    memset(d->slots, 0xff, d->nslots * sizeof *d->slots);
+
+    // count the positions of each key, then place them in runs
+    d->nkeys = 0;
+    for (size_t j = 0; j < in->n; j++) {
+	size_t s = star_slot(d, in->vals[j]);
+	if (d->slots[s].pos == -1)
+	    d->slots[s] = (struct join_tuple) { in->vals[j], d->nkeys++ };
+	d->runs[d->slots[s].pos + 1]++;
+    }
+    for (size_t k = 0; k < d->nkeys; k++)
+	d->runs[k + 1] += d->runs[k];
+    size_t *cursor = malloc(d->nkeys * sizeof *cursor);
+    assert(cursor || d->nkeys == 0);
+    memcpy(cursor, d->runs, d->nkeys * sizeof *cursor);
+    for (size_t j = 0; j < in->n; j++)
+	d->pos[cursor[d->slots[star_slot(d, in->vals[j])].pos]++] = in->pos[j];
+    free(cursor);
+}
+
+struct star_task {
+    struct join_in const *facts;
+    struct star_dim const *dims;
+    size_t const *order;        // of the dimensions to probe
+    size_t ndims;
+    size_t off;
+    size_t len;
+    size_t n;                   // rows of the slice
+    size_t at;                  // offset of those rows in the result
+    int **out;                  // the result, NULL while counting
+};
+
+/* the rows of a fact slice, written to |out| unless it is NULL */
+static
+void star_slice(void *arg) {
+    struct star_task *t = arg;
+    size_t run[JOIN_STAR_MAX_DIMS], idx[JOIN_STAR_MAX_DIMS];
+    size_t k = t->at;
+    for (size_t j = t->off; j < t->off + t->len; j++) {
+	size_t prod = 1;
+	for (size_t o = 0; o < t->ndims && prod; o++) {
+	    size_t d = t->order[o];
+	    struct join_tuple const *slot = &t->dims[d].slots[star_slot(&t->dims[d], t->facts[d].vals[j])];
+	    run[d] = slot->pos;
+	    prod = (slot->pos == -1) ? 0 : prod * (t->dims[d].runs[run[d] + 1] - t->dims[d].runs[run[d]]);
+	}
+	if (t->out == NULL || prod == 0) {
+	    k += prod;
+	    continue;
+	}
+
+	// every combination of the matches, the last dimension varying fastest
+	memset(idx, 0, t->ndims * sizeof *idx);
+	for (size_t p = 0; p < prod; p++, k++) {
+	    t->out[0][k] = t->facts[0].pos[j];
+	    for (size_t d = 0; d < t->ndims; d++)
+		t->out[d + 1][k] = t->dims[d].pos[t->dims[d].runs[run[d]] + idx[d]];
+	    for (size_t d = t->ndims; d-- > 0; ) {
+		if (++idx[d] < t->dims[d].runs[run[d] + 1] - t->dims[d].runs[run[d]]) break;
+		idx[d] = 0;
+	    }
+	}
+    }
+    t->n = k - t->at;
+}
+
+/*
+ * Fact slices are counted, then written at their offsets in results of
+ * exactly the right size, over the execution pool.
+ */
+bool join_star(struct join_in const *facts, struct join_in const *dims, size_t ndims,
+	       struct cvec **res) {
+    if (ndims == 0 || ndims > JOIN_STAR_MAX_DIMS) return false;
+    struct star_dim sd[JOIN_STAR_MAX_DIMS];
+    size_t order[JOIN_STAR_MAX_DIMS];
+    for (size_t d = 0; d < ndims; d++) {
+	star_build(&sd[d], &dims[d]);
+	size_t o = d;
+	for (; o > 0 && sd[order[o - 1]].nkeys > sd[d].nkeys; o--)
+	    order[o] = order[o - 1];
+	order[o] = d;
+    }
+
+    size_t n = facts[0].n;
+    struct tpool *tp = exec_pool();
+    size_t nt = tpool_tasks(tp, n, JOIN_PARALLEL_MIN);
+    struct star_task *ts = malloc(nt * sizeof *ts);
+    assert(ts);
+    for (size_t t = 0; t < nt; t++) {
+	size_t len, off = tpool_slice(n, nt, t, &len);
+	ts[t] = (struct star_task) { facts, sd, order, ndims, off, len, 0, 0, NULL };
+    }
+    tpool_run(tp, star_slice, ts, nt, sizeof *ts);
+
+    size_t total = 0;
+    for (size_t t = 0; t < nt; t++) {
+	ts[t].at = total;
+	total += ts[t].n;
+    }
+    int *out[JOIN_STAR_MAX_DIMS + 1];
+    for (size_t d = 0; d <= ndims; d++) {
+	out[d] = malloc(total * sizeof *out[d]);
+	assert(out[d] || total == 0);
+    }
+    for (size_t t = 0; t < nt; t++) ts[t].out = out;
+    tpool_run(tp, star_slice, ts, nt, sizeof *ts);
+
+    for (size_t d = 0; d <= ndims; d++)
+	res[d] = out_vector(out[d], total);
+    for (size_t d = 0; d < ndims; d++) {
+	free(sd[d].slots);
+	free(sd[d].runs);
+	free(sd[d].pos);
+    }
+    free(ts);
+    cs165_log(stderr, "join_star: %zu rows of %zu facts, %zu dimensions\n", total, n, ndims);
+    return true;
+}
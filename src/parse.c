@@ -9,7 +9,6 @@
 #include "utils.h"
 #include "dbo.h"
 #include "parse.h"
-#include "sync.h"
 
 typedef db_operator *(*cmdptr)(size_t, const char**);
 static struct {
@@ -17,9 +16,15 @@ static struct {
     cmdptr fnptr;
 } command_map[] = {
     { "add", cmd_add },
+    { "antijoin", cmd_antijoin },
     { "avg", cmd_avg },
+    { "batch_execute", cmd_batch_execute },     // no response
+    { "batch_queries", cmd_batch_queries },     // no response
+    { "count", cmd_count },
     { "create", cmd_create },   // no response
     { "fetch", cmd_fetch },
+    { "free", cmd_free },                       // no response
+    { "groupby", cmd_groupby },
     { "hashjoin", cmd_join },
     //{ "load", cmd_load },       // no response
     { "max", cmd_max },
@@ -27,7 +32,11 @@ static struct {
     { "relational_delete", cmd_rel_delete },    // no response
     { "relational_insert", cmd_rel_insert },    // no response
     { "select", cmd_select },
+    { "semijoin", cmd_semijoin },
+    { "sortmergejoin", cmd_mergejoin },
+    { "starjoin", cmd_starjoin },
     { "sub", cmd_sub },
+    { "sum", cmd_sum },
     //{ "sync", cmd_sync },                       // no response
     { "tuple", cmd_tuple },
     { "update", cmd_update },                   // no response
@@ -35,24 +44,26 @@ static struct {
 };
 
 static
-const char **tokenize_args(char *msg, size_t *num_args) {
+const char **tokenize_args(char *msg, size_t *num_args, size_t *num_vars) {
     char *args_start = strchr(msg, OPEN_PAREN);
     char *end = strchr(msg, CLOSE_PAREN);
     size_t argc = count_ch(args_start, COMMA) + 1 + 1; // extra 1 for cmd name
+    if (args_start + 1 == end) argc--;                  // no arguments
 
     *end = *args_start = '\0';
 
     char *eq = strchr(msg, EQUALS);
     char *cmd = (eq) ? eq + 1 : msg;
 
-    char *comma = NULL;
+    size_t nvars = 0;
     if (eq) {
         *eq = '\0';
-        argc += (comma = strchr(msg, COMMA)) ? 2 : 1;   // one or two return vars;
+        nvars = count_ch(msg, COMMA) + 1;               // return vars, two for joins
+        argc += nvars;
         *eq = EQUALS;
     }
 
-    const char **args_arr = malloc(argc * sizeof(void *) + 1);
+    const char **args_arr = malloc((argc + 1) * sizeof *args_arr);
 
     char *sep = ",";
     size_t i = 0;
@@ -61,18 +72,18 @@ const char **tokenize_args(char *msg, size_t *num_args) {
          arg = strtok_r(NULL, sep, &tmp)) { args_arr[i++] = arg; }
 
     if (eq) {
-        args_arr[i++] = msg;
-        if (comma) {    // two return vars
-            *comma = '\0';
-            args_arr[i++] = comma + 1;
-        }
         *eq = '\0';
+        for (char *var = msg, *comma; var; var = (comma) ? comma + 1 : NULL) {
+            if ((comma = strchr(var, COMMA)) != NULL) *comma = '\0';
+            args_arr[i++] = var;
+        }
     }
 
     args_arr[i++] = cmd;
     args_arr[i] = NULL;
 
     *num_args = argc;
+    *num_vars = nvars;
     assert (argc == i);
     return args_arr;
 }
@@ -109,17 +120,20 @@ db_operator *parse_command(message *recv_message, message *send_message) {
     cs165_log(stdout, recv_message->payload);
     if (strncmp(recv_message->payload, "--", 2) == 0) {
         send_message->status = OK_DONE;
+        send_message->count = 0;
         return NULL;
     }
 
     if (strncmp(recv_message->payload, "shutdown", 8) == 0) {
         send_message->status = OK_DONE;
-        sync();
-        return NULL;
+        send_message->count = 0;
+        dbo = malloc(sizeof *dbo);
+        if (dbo != NULL) dbo->type = SYNC;    // the server syncs once idle
+        return dbo;
     }
 
-    size_t argc;
-    const char **argv = tokenize_args(recv_message->payload, &argc);
+    size_t argc, nvars;
+    const char **argv = tokenize_args(recv_message->payload, &argc, &nvars);
     for (size_t j = 0; j < argc; j++) {
         cs165_log(stderr, "%s ", argv[j]);
     }
@@ -133,6 +147,20 @@ db_operator *parse_command(message *recv_message, message *send_message) {
         return dbo;
     }
 
+    // a star join binds the facts and each dimension, which has 3 operands
+    if (fn == cmd_starjoin && argc != 4 * nvars - 1) {
+        send_message->status = INCORRECT_FORMAT;
+        free(argv);
+        return dbo;
+    }
+
+    // a group by binds the keys and one result per value and aggregate
+    if (fn == cmd_groupby && argc != 3 * nvars) {
+        send_message->status = INCORRECT_FORMAT;
+        free(argv);
+        return dbo;
+    }
+
     dbo = fn(argc, argv);
     free(argv);
 
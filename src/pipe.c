@@ -0,0 +1,226 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "pipe.h"
+#include "cvec.h"
+#include "simd.h"
+#include "bitmap.h"
+#include "tpool.h"
+#include "utils.h"
+
+/* positions per morsel of a parallel pipeline, a multiple of ZONE_SIZE */
+#define PIPE_MORSEL (1 << 14)
+
+/*
+ * Vector-at-a-time execution: a pipeline pulls PIPE_VECTOR positions from
+ * its source, narrows them through its filters and computes its values for
+ * the survivors, so each stage works on a few KB that stay in cache and no
+ * intermediate grows with the table.
+ */
+
+void pipe_init(struct pipe *p) {
+    memset(p, 0, sizeof *p);
+}
+
+/* NULL when the pipeline has no room for another expression */
+struct pipe_expr *pipe_node(struct pipe *p, enum pipe_op op) {
+    if (p->nexprs == PIPE_MAX_EXPRS) return NULL;
+    struct pipe_expr *e = &p->exprs[p->nexprs++];
+    memset(e, 0, sizeof *e);
+    e->op = op;
+    return e;
+}
+
+bool pipe_filter(struct pipe *p, struct pipe_expr *expr, int low, int high) {
+    if (p->nfilters == PIPE_MAX_FILTERS) return false;
+    p->filters[p->nfilters++] = (struct pipe_filter) { expr, low, high };
+    return true;
+}
+
+/* the number of positions or bits the source is read in */
+static inline
+size_t pipe_domain(struct pipe const *p) {
+    if (p->pos == NULL) return p->sz;
+    return (p->pos->type == BITMAP) ? p->pos->nbits : p->pos->num_tuples;
+}
+
+/* the source positions in [off, off + n), which lies in one zone */
+static
+size_t pipe_source(struct pipe const *p, int *pos, size_t off, size_t n) {
+    struct cvec const *src = p->pos;
+    if (src == NULL) {
+	switch (sscan_zone(&p->q, off / ZONE_SIZE)) {
+	    case ZONE_NONE:
+		return 0;
+	    case ZONE_ALL:
+		for (size_t j = 0; j < n; j++) pos[j] = off + j;
+		return n;
+	    case ZONE_SOME:
+		return (p->q.point)
+		    ? simd_point(pos, p->svals + off, n, p->q.low, off)
+		    : simd_range(pos, p->svals + off, n, p->q.low, p->q.high, off);
+	}
+    }
+
+    switch (src->type) {
+	case RANGE:
+	    for (size_t j = 0; j < n; j++) pos[j] = src->start + off + j;
+	    return n;
+	case BITMAP: {
+	    size_t k = bitmap_positions(pos, src->bits + off / 64, n);
+	    for (size_t j = 0; j < k; j++) pos[j] += off;
+	    return k;
+	}
+	default:
+	    memcpy(pos, src->values + off, n * sizeof *pos);
+	    return n;
+    }
+}
+
+static
+void pipe_eval(struct pipe_expr const *e, const int *pos, size_t n, long int *out) {
+    if (e->op == PIPE_FETCH) {
+	for (size_t j = 0; j < n; j++) out[j] = e->vals[pos[j]];
+	return;
+    }
+    long int right[PIPE_VECTOR];
+    pipe_eval(e->left, pos, n, out);
+    if (e->right == e->left)
+	memcpy(right, out, n * sizeof *right);
+    else
+	pipe_eval(e->right, pos, n, right);
+    if (e->op == PIPE_ADD)
+	for (size_t j = 0; j < n; j++) out[j] += right[j];
+    else
+	for (size_t j = 0; j < n; j++) out[j] -= right[j];
+}
+
+/* the positions of [off, off + n) of the source that pass every filter */
+static
+size_t pipe_vector(struct pipe const *p, int *pos, size_t off, size_t n) {
+    long int vals[PIPE_VECTOR];
+    size_t k = pipe_source(p, pos, off, n);
+    for (size_t f = 0; f < p->nfilters && k; f++) {
+	struct pipe_filter const *flt = &p->filters[f];
+	pipe_eval(flt->expr, pos, k, vals);
+	size_t m = 0;
+	for (size_t j = 0; j < k; j++) {
+	    pos[m] = pos[j];
+	    m += (vals[j] >= flt->low && vals[j] < flt->high);
+	}
+	k = m;
+    }
+    return k;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+struct pipe_task {
+    struct pipe const *p;
+    size_t base;
+    size_t len;
+    struct agg_acc acc;
+};
+
+static
+void pipe_morsel(void *arg) {
+    struct pipe_task *t = arg;
+    int pos[PIPE_VECTOR];
+    long int vals[PIPE_VECTOR];
+
+    acc_init(&t->acc);
+    for (size_t off = t->base; off < t->base + t->len; off += PIPE_VECTOR) {
+	size_t n = (t->base + t->len - off < PIPE_VECTOR) ? t->base + t->len - off : PIPE_VECTOR;
+	size_t k = pipe_vector(t->p, pos, off, n);
+	if (k == 0) continue;
+	pipe_eval(t->p->out, pos, k, vals);
+
+	long int min = t->acc.min, max = t->acc.max;
+	__int128 sum = 0;
+	for (size_t j = 0; j < k; j++) {
+	    min = (vals[j] < min) ? vals[j] : min;
+	    max = (vals[j] > max) ? vals[j] : max;
+	    sum += vals[j];
+	}
+	t->acc.min = min;
+	t->acc.max = max;
+	t->acc.sum += sum;
+	t->acc.count += k;
+    }
+}
+
+/* aggregates the values of |p|, in morsels over the execution pool */
+void pipe_aggregate(struct pipe const *p, struct agg_acc *acc) {
+    assert(p->out);
+    struct tpool *tp = exec_pool();
+    size_t sz = pipe_domain(p);
+    size_t nm = (sz + PIPE_MORSEL - 1) / PIPE_MORSEL;
+    if (tp == NULL || nm < 2) nm = (sz) ? 1 : 0;
+
+    struct pipe_task *ts = malloc(nm * sizeof *ts);
+    assert(ts || nm == 0);
+    size_t per = (nm > 1) ? PIPE_MORSEL : sz;
+    for (size_t m = 0; m < nm; m++) {
+	ts[m].p = p;
+	ts[m].base = m * per;
+	ts[m].len = (m == nm - 1) ? sz - m * per : per;
+    }
+
+    tpool_run(tp, pipe_morsel, ts, nm, sizeof *ts);
+
+    acc_init(acc);
+    for (size_t m = 0; m < nm; m++)
+	acc_merge(acc, &ts[m].acc);
+    free(ts);
+    cs165_log(stderr, "pipe_aggregate: %zu of %zu\n", acc->count, sz);
+}
+
+/*
+ * The result of |p|: its positions as a VECTOR, the fetched values as a
+ * VECTOR or the values of an add/sub as a LONG_VECTOR. Only the result
+ * itself is allocated.
+ */
+struct cvec *pipe_collect(struct pipe const *p) {
+    bool wide = p->out && p->out->op != PIPE_FETCH;
+    size_t width = (wide) ? sizeof(long int) : sizeof(int);
+    size_t sz = pipe_domain(p), cap = PIPE_VECTOR, num = 0;
+    char *res = malloc(cap * width);
+    assert(res);
+    int pos[PIPE_VECTOR];
+    long int vals[PIPE_VECTOR];
+
+    for (size_t off = 0; off < sz; off += PIPE_VECTOR) {
+	size_t n = (sz - off < PIPE_VECTOR) ? sz - off : PIPE_VECTOR;
+	size_t k = pipe_vector(p, pos, off, n);
+	if (k == 0) continue;
+	if (num + k > cap) {
+	    cap *= 2;
+	    res = realloc(res, cap * width);
+	    assert(res);
+	}
+
+	if (p->out == NULL) {
+	    memcpy((int *) res + num, pos, k * sizeof *pos);
+	} else {
+	    pipe_eval(p->out, pos, k, vals);
+	    if (wide)
+		memcpy((long int *) res + num, vals, k * sizeof *vals);
+	    else
+		for (size_t j = 0; j < k; j++) ((int *) res)[num + j] = vals[j];
+	}
+	num += k;
+    }
+    cs165_log(stderr, "pipe_collect: %zu of %zu\n", num, sz);
+
+    struct cvec *ret = cvec_alloc();
+    ret->num_tuples = num;
+    if (wide) {
+	ret->long_values = realloc(res, num * width);
+	ret->type = LONG_VECTOR;
+    } else {
+	ret->values = realloc(res, num * width);
+	ret->type = VECTOR;
+    }
+    return ret;
+}
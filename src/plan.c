@@ -0,0 +1,103 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "plan.h"
+#include "cvec.h"
+
+/*
+ * Every pending plan of every session, oldest first: an operator that
+ * modifies the database forces them all before it runs, so a plan always
+ * sees the data as of the query that deferred it.
+ */
+static pthread_mutex_t plans_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct plan *plans;
+static struct plan *last;
+
+/* the results an operator reads, NULL where it has none */
+static inline
+void plan_operands(db_operator *op, struct cvec **in) {
+    in[0] = in[1] = NULL;
+    switch(op->type) {
+        case(PROJECT):
+            in[0] = op->pos1;
+            break;
+        case(AGGREGATE_RES):
+            in[0] = op->vals1;
+            break;
+        case(SELECT2):
+            in[0] = op->pos1;
+            in[1] = op->vals1;
+            break;
+        case(ADD): case(SUB):
+            in[0] = op->vals1;
+            in[1] = op->vals2;
+            break;
+        default: break;
+    }
+}
+
+/* selects, select2s, fetches from a column, add/subs and aggregates of a result */
+bool plan_deferrable(db_operator *op) {
+    struct cvec *in[2];
+    plan_operands(op, in);
+    switch(op->type) {
+        case(SELECT): case(POINT_SELECT):
+            return true;
+        case(PROJECT): case(AGGREGATE_RES):
+            return in[0] != NULL;
+        case(SELECT2): case(ADD): case(SUB):
+            return in[0] != NULL && in[1] != NULL;
+        default:
+            return false;
+    }
+}
+
+/* returns the PENDING result of |op|, for the caller to bind */
+struct cvec *plan_defer(db_operator *op) {
+    struct plan *p = malloc(sizeof *p);
+    assert(p);
+    p->op = op;
+    p->result = cvec_alloc();
+    p->result->type = PENDING;
+    p->result->plan = p;
+    p->unpiped = false;
+
+    struct cvec *in[2];
+    plan_operands(op, in);
+    for (int j = 0; j < 2; j++)
+        if (in[j]) cvec_retain(in[j]);
+
+    pthread_mutex_lock(&plans_lock);
+    p->prev = last;
+    p->next = NULL;
+    if (last) last->next = p;
+    else plans = p;
+    last = p;
+    pthread_mutex_unlock(&plans_lock);
+    return p->result;
+}
+
+struct plan *plan_first(void) {
+    pthread_mutex_lock(&plans_lock);
+    struct plan *p = plans;
+    pthread_mutex_unlock(&plans_lock);
+    return p;
+}
+
+/* once |p| is forced, or its result freed unforced */
+void plan_free(struct plan *p) {
+    pthread_mutex_lock(&plans_lock);
+    if (p->prev) p->prev->next = p->next;
+    else plans = p->next;
+    if (p->next) p->next->prev = p->prev;
+    else last = p->prev;
+    pthread_mutex_unlock(&plans_lock);
+
+    struct cvec *in[2];
+    plan_operands(p->op, in);
+    for (int j = 0; j < 2; j++)
+        if (in[j]) cvec_release(in[j]);
+    free(p->op);
+    free(p);
+}
@@ -18,6 +18,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/epoll.h>
 #include <sys/un.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -31,8 +32,10 @@
 #include "parse.h"
 #include "execute.h"
 #include "sync.h"
+#include "tpool.h"
+#include "session.h"
 
-#define DEFAULT_QUERY_BUFFER_SIZE 8192
+#define MAX_EVENTS 64
 
 // Here, we allow for a global of DSL COMMANDS to be shared in the program
 //dsl** dsl_commands;
@@ -83,6 +86,12 @@ int prepare_response(struct cvec *result, void **payload) {
                 *payload = result->long_values;
                 length = result->num_tuples * sizeof(long int);
                 break;
+            case DOUBLE_VECTOR:
+                *payload = result->double_values;
+                length = result->num_tuples * sizeof(long double);
+                break;
+            case BITMAP: case RANGE: case PENDING:    // tuple() sends position lists
+                assert(false);
         }
     }
     return length;
@@ -91,10 +100,10 @@ int prepare_response(struct cvec *result, void **payload) {
 int sendall(int s, char *buf, int *len) {
     int total = 0;        // how many bytes we've sent
     int bytesleft = *len; // how many we have left to send
-    int n;
+    int n = 0;
 
     while(total < *len) {
-        n = send(s, buf+total, bytesleft, 0);
+        n = send(s, buf+total, bytesleft, MSG_NOSIGNAL);
         if (n == -1) { break; }
         total += n;
         bytesleft -= n;
@@ -105,107 +114,228 @@ int sendall(int s, char *buf, int *len) {
     return n == -1 ? -1 : 0; // return -1 on failure, 0 on success
 }
 
+static
+int recvall(int s, char *buf, int len) {
+    int total = 0;        // how many bytes we've received
+
+    while (total < len) {
+        int n = recv(s, buf + total, len - total, MSG_WAITALL);
+        if (n <= 0) return n;
+        total += n;
+    }
+
+    return total;
+}
+
 /**
- * handle_client(client_socket)
- * This is the execution routine after a client has connected.
- * It will continually listen for messages from the client and execute queries.
+ * conn
+ * One connected client. The socket is registered with EPOLLONESHOT, so at
+ * most one message of a client is in flight at a time: the fd is re-armed
+ * only after the response for the previous query has been sent. This keeps
+ * the queries of a single client ordered while different clients run on
+ * different workers.
  **/
-void handle_client(int client_socket) {
-    int done = 0;
-    int length = 0;
+struct conn {
+    int fd;
+    message send_message;
+    struct session *session;    // freed on disconnect
+};
 
-    log_info("Connected to socket: %d.\n", client_socket);
+/**
+ * request
+ * A parsed query handed from the event loop to a worker thread.
+ * |payload| is the raw message; bulk loads parse it in place, so it is
+ * released only after the query is executed.
+ **/
+struct request {
+    struct conn *conn;
+    db_operator *query;
+    char *payload;
+};
 
-    // Create two messages, one from which to read and one from which to receive
-    message send_message = {0, 0, 0, 0, 0};
-    message recv_message;
+static int epoll_fd;
+static struct tpool *workers;
+static bool running = true;
+
+static
+void close_conn(struct conn *c) {
+    log_info("Connection closed at socket %d!\n", c->fd);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    execute_session_end(c->session);
+    free(c);
+}
+
+static
+bool rearm_conn(struct conn *c) {
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = c };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev) == -1) {
+        log_err("L%d: Failed to re-arm socket %d.\n", __LINE__, c->fd);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * respond(c, result)
+ * Sends the status of the last message and, if the client waits for it,
+ * the result columns, each after its column_header. Returns false if the
+ * client went away.
+ **/
+static
+bool respond(struct conn *c, struct cvec **result) {
+    message *send_message = &c->send_message;
+
+    // prepare the response
+    void *resp_payload = NULL;
+    if (result == NULL)
+        send_message->length = 0;
+    else {
+        // results are computed at tuple() time, after the parser guessed the type
+        send_message->payload_type = result[0]->type;
+        send_message->length = 0;
+        for (int j = 0; j < send_message->count; j++)
+            send_message->length += prepare_response(result[j], &resp_payload);
+    }
+
+    log_info("status %d of len %d\n", send_message->status, send_message->length);
 
-    // Continually receive messages from client and execute queries.
-    // 1. Parse the command
-    // 2. Handle request if appropriate
     // 3. Send status of the received message (OK, UNKNOWN_QUERY, etc)
-    // 4. Send response of request.
-    do {
-        length = recv(client_socket, &recv_message, sizeof(message), 0);
-        //log_info("received length %d %d\n", length, recv_message.length);
-        if (length < 0) {
-            log_err("Client connection closed!\n");
-            exit(1);
-        } else if (length == 0) {
-            done = 1;
-        }
+    if (send(c->fd, send_message, sizeof(message), MSG_NOSIGNAL) == -1) {
+        log_err("Failed to send message.");
+        return false;
+    }
 
-        bool is_file = (STRDATA == recv_message.status) ? true : false;
-
-        if (!done) {
-            char *buf = NULL;
-            char recv_buffer[DEFAULT_QUERY_BUFFER_SIZE];
-            length = recv(client_socket, recv_buffer, recv_message.length, 0);
-            //log_info("received first payload %d\n", length);
-
-            if (is_file) { // receiving a file
-                buf = malloc(recv_message.length + 1);
-                memcpy(buf, recv_buffer, length);
-                ssize_t read = length;
-                while (read < recv_message.length) {
-                    length = recv(client_socket, recv_buffer, DEFAULT_QUERY_BUFFER_SIZE, 0);
-                    //log_info("received next payload %d\n", length);
-                    memcpy(buf + read, recv_buffer, length);
-                    read += length;
-                }
-                recv_message.payload = buf;
-                recv_message.payload[read] = '\0';
-                //log_info("total length %d\n", read);
-            } else { //simple query
-                recv_message.payload = recv_buffer;
-                recv_message.payload[recv_message.length] = '\0';
+    // 4. Send response of request
+    if (send_message->status == OK_WAIT_FOR_RESPONSE && send_message->length > 0) {
+        for (int j = 0; j < send_message->count; j++) {
+            int len = prepare_response(result[j], &resp_payload);
+            column_header header = { result[j]->type, len };
+            if (send(c->fd, &header, sizeof header, MSG_NOSIGNAL) == -1) {
+                log_err("Failed to send column header.");
+                return false;
+            }
+            int sent = sendall(c->fd, resp_payload, &len);
+            log_info("server sent %d status = %d\n", len, sent);
+            if (sent == -1) {
+                log_err("Failed to send message.");
+                return false;
             }
+        }
+    }
 
-            // 1. Parse command
-            db_operator *query = parse_command(&recv_message, &send_message);
+    return true;
+}
 
-            // 2. Handle request
-            struct cvec **result = NULL;
-            struct status st = execute_db_operator(query, &result);
-            // TODO, check for ERROR status_code
-            (void)st;
+/**
+ * serve(arg)
+ * Worker side of a request: executes the query, answers the client and
+ * hands the socket back to the event loop.
+ **/
+static
+void serve(void *arg) {
+    struct request *req = arg;
+    struct conn *c = req->conn;
 
-            // free file buf after loading
-            if (buf != NULL) free(buf);
+    // 2. Handle request
+    session_enter(c->session);
+    struct cvec **result = NULL;
+    struct status st = execute_db_operator(req->query, &result);
+    if (st.code != OK)
+        log_info("query on socket %d: %s\n", c->fd, st.message);
 
-            // prepare the response
-            void *resp_payload = NULL;
-            if (result == NULL)
-                send_message.length = 0;
-            else
-                send_message.length = send_message.count * prepare_response(result[0], &resp_payload);
+    // free file buf after loading
+    free(req->payload);
+    free(req);
 
-            log_info("status %d of len %d\n", send_message.status, send_message.length);
+    bool alive = respond(c, result);
+    free(result);
 
-            // 3. Send status of the received message (OK, UNKNOWN_QUERY, etc)
-            if (send(client_socket, &(send_message), sizeof(message), 0) == -1) {
-                log_err("Failed to send message.");
-                exit(1);
-            }
+    if (!alive || !rearm_conn(c)) close_conn(c);
+}
 
-            // 4. Send response of request
-            if (send_message.status == OK_WAIT_FOR_RESPONSE && send_message.length > 0) {
-                for (int j = 0; j < send_message.count; j++) {
-                    int len = prepare_response(result[j], &resp_payload);
-                    ssize_t sent = sendall(client_socket, resp_payload, &len);
-                    log_info("server sent %d status = %d\n", len, sent);
-                    if (sent == -1) {
-                        log_err("Failed to send message.");
-                        exit(1);
-                    }
-                }
-            }
-            free(result);
-        }
-    } while (!done);
+/**
+ * handle_message(c)
+ * This is the execution routine when a client socket becomes readable.
+ * It receives one message, parses it and dispatches the query to the
+ * worker pool. Returns false when the client has disconnected.
+ **/
+static
+bool handle_message(struct conn *c) {
+    message recv_message;
+
+    int length = recvall(c->fd, (char *) &recv_message, sizeof(message));
+    if (length < 0) {
+        log_err("Client connection closed!\n");
+        return false;
+    } else if (length == 0) {
+        return false;
+    }
+
+    // receiving either a query or a file, both end up in a heap buffer
+    char *buf = malloc(recv_message.length + 1);
+    assert(buf);
+    length = recvall(c->fd, buf, recv_message.length);
+    if (length != recv_message.length) {
+        log_err("Client sent a truncated payload!\n");
+        free(buf);
+        return false;
+    }
+    buf[length] = '\0';
+    recv_message.payload = buf;
+
+    // 1. Parse command
+    session_enter(c->session);
+    db_operator *query = parse_command(&recv_message, &c->send_message);
+
+    if (query != NULL && query->type == SYNC) {
+        // stop taking new work; the database is synced once in-flight
+        // queries of the other clients have drained
+        running = false;
+        free(query);
+        query = NULL;
+    }
+
+    if (query == NULL) {
+        free(buf);
+        return respond(c, NULL) && rearm_conn(c);
+    }
 
-    log_info("Connection closed at socket %d!\n", client_socket);
-    close(client_socket);
+    struct request *req = malloc(sizeof *req);
+    assert(req);
+    req->conn = c;
+    req->query = query;
+    req->payload = buf;
+    tpool_submit(workers, serve, req);
+    return true;
+}
+
+static
+void accept_conn(int server_socket) {
+    struct sockaddr_un remote;
+    socklen_t t = sizeof(remote);
+    int client_socket = accept(server_socket, (struct sockaddr *)&remote, &t);
+    if (client_socket == -1) {
+        log_err("L%d: Failed to accept a new connection.\n", __LINE__);
+        return;
+    }
+
+    log_info("Connected to socket: %d.\n", client_socket);
+
+    struct conn *c = malloc(sizeof *c);
+    assert(c);
+    memset(c, 0, sizeof *c);
+    c->fd = client_socket;
+    c->session = session_create();
+    assert(c->session);
+
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = c };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &ev) == -1) {
+        log_err("L%d: Failed to watch socket %d.\n", __LINE__, client_socket);
+        close(client_socket);
+        execute_session_end(c->session);
+        free(c);
+    }
 }
 
 /**
@@ -253,10 +383,9 @@ int setup_server() {
     return server_socket;
 }
 
-// Currently this main will setup the socket and accept a single client.
-// After handling the client, it will exit.
-// You will need to extend this to handle multiple concurrent clients
-// and remain running until it receives a shut-down command.
+// The main thread runs the event loop: it accepts clients, reads and parses
+// their messages and hands the queries to the worker pool. The server keeps
+// running across client disconnects until a client sends shutdown.
 int main(void) {
     restore_database();
 
@@ -265,21 +394,52 @@ int main(void) {
         exit(1);
     }
 
+    if ((epoll_fd = epoll_create1(0)) == -1) {
+        log_err("L%d: Failed to create epoll instance.\n", __LINE__);
+        exit(1);
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_socket, &ev) == -1) {
+        log_err("L%d: Failed to watch server socket.\n", __LINE__);
+        exit(1);
+    }
+
+    workers = tpool_create(num_cores());
+    if (workers == NULL) {
+        log_err("L%d: Failed to start workers.\n", __LINE__);
+        exit(1);
+    }
+
     // Populate the global dsl commands
     //dsl_commands = dsl_commands_init();
 
     log_info("Waiting for a connection %d ...\n", server_socket);
 
-    struct sockaddr_un remote;
-    socklen_t t = sizeof(remote);
-    int client_socket = 0;
+    struct epoll_event events[MAX_EVENTS];
+    while (running) {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            log_err("L%d: epoll_wait failed.\n", __LINE__);
+            break;
+        }
 
-    if ((client_socket = accept(server_socket, (struct sockaddr *)&remote, &t)) == -1) {
-        log_err("L%d: Failed to accept a new connection.\n", __LINE__);
-        exit(1);
+        for (int j = 0; j < n && running; j++) {
+            struct conn *c = events[j].data.ptr;
+            if (c == NULL)
+                accept_conn(server_socket);
+            else if (!handle_message(c))
+                close_conn(c);
+        }
     }
 
-    handle_client(client_socket);
+    // finish the queries that are already dispatched, then persist
+    tpool_destroy(workers);
+    close(server_socket);
+    close(epoll_fd);
+    unlink(SOCK_PATH);
+    sync();
 
     return 0;
 }
@@ -0,0 +1,60 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "session.h"
+#include "symtable.h"
+
+#define DEFAULT_BATCH_CAPACITY 16
+
+static _Thread_local struct session *current;
+
+struct session *session_create(void) {
+    struct session *s = malloc(sizeof *s);
+    if (s == NULL) return NULL;
+
+    s->vars = symtable_create();
+    if (s->vars == NULL) {
+        free(s);
+        return NULL;
+    }
+
+    s->batching = false;
+    s->batch_sz = 0;
+    s->batch_capacity = 0;
+    s->batch = NULL;
+    return s;
+}
+
+void session_free(struct session *s) {
+    if (s == NULL) return;
+    if (current == s) current = NULL;
+
+    for (size_t j = 0; j < s->batch_sz; j++) {
+        free(s->batch[j]->assign_var);
+        free(s->batch[j]);
+    }
+    free(s->batch);
+    symtable_free(s->vars);
+    free(s);
+}
+
+/* installs |s| for the queries the calling thread parses or executes next */
+void session_enter(struct session *s) {
+    current = s;
+    map_set_scope(s ? s->vars : NULL);
+}
+
+struct session *session_current(void) {
+    return current;
+}
+
+void session_defer(struct session *s, db_operator *query) {
+    if (s->batch_sz == s->batch_capacity) {
+        size_t capacity = s->batch_capacity ? s->batch_capacity * 2 : DEFAULT_BATCH_CAPACITY;
+        db_operator **batch = realloc(s->batch, capacity * sizeof *batch);
+        assert(batch);
+        s->batch = batch;
+        s->batch_capacity = capacity;
+    }
+    s->batch[s->batch_sz++] = query;
+}
@@ -0,0 +1,776 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <immintrin.h>
+
+#include "simd.h"
+#include "utils.h"
+
+/*
+ * The kernels are compiled for AVX2 and AVX-512 regardless of the build
+ * flags and picked at run time by what the CPU supports. Every vector loop
+ * leaves the tail to the scalar loop, which is also the fallback.
+ */
+
+typedef size_t (*range_fn)(int *, const int *, size_t, int, int, int);
+typedef size_t (*point_fn)(int *, const int *, size_t, int, int);
+typedef size_t (*range_pos_fn)(int *, const int *, const int *, size_t, int, int);
+typedef size_t (*range_bits_fn)(uint64_t *, const int *, size_t, int, int);
+typedef size_t (*point_bits_fn)(uint64_t *, const int *, size_t, int);
+typedef int (*agg_fn)(const int *, size_t);
+typedef long int (*sum_fn)(const int *, size_t);
+typedef long int (*agg_long_fn)(const long int *, size_t);
+typedef __int128 (*sum_long_fn)(const long int *, size_t);
+
+static inline
+size_t range_scalar(int *out, const int *vals, size_t n, int low, int high, int base) {
+    size_t k = 0;
+    for (size_t j = 0; j < n; j++) {
+        out[k] = base + j;
+        k += (vals[j] >= low && vals[j] < high);
+    }
+    return k;
+}
+
+static inline
+size_t point_scalar(int *out, const int *vals, size_t n, int value, int base) {
+    size_t k = 0;
+    for (size_t j = 0; j < n; j++) {
+        out[k] = base + j;
+        k += (vals[j] == value);
+    }
+    return k;
+}
+
+static inline
+size_t range_pos_scalar(int *out, const int *pos, const int *vals, size_t n, int low, int high) {
+    size_t k = 0;
+    for (size_t j = 0; j < n; j++) {
+        out[k] = pos[j];
+        k += (vals[j] >= low && vals[j] < high);
+    }
+    return k;
+}
+
+static inline
+size_t range_bits_scalar(uint64_t *bits, const int *vals, size_t n, int low, int high) {
+    size_t count = 0;
+    for (size_t j = 0; j < n; j += 64) {
+        size_t len = (n - j < 64) ? n - j : 64;
+        uint64_t word = 0;
+        for (size_t b = 0; b < len; b++)
+            word |= (uint64_t) (vals[j + b] >= low && vals[j + b] < high) << b;
+        bits[j / 64] = word;
+        count += __builtin_popcountll(word);
+    }
+    return count;
+}
+
+static inline
+size_t point_bits_scalar(uint64_t *bits, const int *vals, size_t n, int value) {
+    size_t count = 0;
+    for (size_t j = 0; j < n; j += 64) {
+        size_t len = (n - j < 64) ? n - j : 64;
+        uint64_t word = 0;
+        for (size_t b = 0; b < len; b++)
+            word |= (uint64_t) (vals[j + b] == value) << b;
+        bits[j / 64] = word;
+        count += __builtin_popcountll(word);
+    }
+    return count;
+}
+
+static
+size_t range_generic(int *out, const int *vals, size_t n, int low, int high, int base) {
+    return range_scalar(out, vals, n, low, high, base);
+}
+
+static
+size_t point_generic(int *out, const int *vals, size_t n, int value, int base) {
+    return point_scalar(out, vals, n, value, base);
+}
+
+static
+size_t range_pos_generic(int *out, const int *pos, const int *vals, size_t n, int low, int high) {
+    return range_pos_scalar(out, pos, vals, n, low, high);
+}
+
+static
+size_t range_bits_generic(uint64_t *bits, const int *vals, size_t n, int low, int high) {
+    return range_bits_scalar(bits, vals, n, low, high);
+}
+
+static
+size_t point_bits_generic(uint64_t *bits, const int *vals, size_t n, int value) {
+    return point_bits_scalar(bits, vals, n, value);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// AVX2: a comparison mask of 8 lanes indexes a table of permutations that
+// move the selected lanes to the front; all 8 lanes are stored and the
+// output advances by the number of selected ones.
+
+static uint32_t perm[256][8] __attribute__((aligned(32)));
+
+static
+void perm_init(void) {
+    for (int m = 0; m < 256; m++) {
+        int k = 0;
+        for (int b = 0; b < 8; b++)
+            if (m & (1 << b)) perm[m][k++] = b;
+        while (k < 8) perm[m][k++] = 0;
+    }
+}
+
+__attribute__((target("avx2")))
+static inline
+__m256i compress8(__m256i v, unsigned mask) {
+    __m256i p = _mm256_load_si256((const __m256i *) perm[mask]);
+    return _mm256_permutevar8x32_epi32(v, p);
+}
+
+__attribute__((target("avx2,popcnt")))
+static
+size_t range_avx2(int *out, const int *vals, size_t n, int low, int high, int base) {
+    const __m256i lo = _mm256_set1_epi32(low);
+    const __m256i hi = _mm256_set1_epi32(high);
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i idx = _mm256_add_epi32(_mm256_set1_epi32(base),
+                                   _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    size_t k = 0, j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (vals + j));
+        // low <= v && v < high  ==  !(low > v) && (high > v)
+        __m256i in = _mm256_andnot_si256(_mm256_cmpgt_epi32(lo, v), _mm256_cmpgt_epi32(hi, v));
+        unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(in));
+        _mm256_storeu_si256((__m256i *) (out + k), compress8(idx, mask));
+        k += _mm_popcnt_u32(mask);
+        idx = _mm256_add_epi32(idx, step);
+    }
+    return k + range_scalar(out + k, vals + j, n - j, low, high, base + j);
+}
+
+__attribute__((target("avx2,popcnt")))
+static
+size_t point_avx2(int *out, const int *vals, size_t n, int value, int base) {
+    const __m256i x = _mm256_set1_epi32(value);
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i idx = _mm256_add_epi32(_mm256_set1_epi32(base),
+                                   _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    size_t k = 0, j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (vals + j));
+        unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, x)));
+        if (mask) {
+            _mm256_storeu_si256((__m256i *) (out + k), compress8(idx, mask));
+            k += _mm_popcnt_u32(mask);
+        }
+        idx = _mm256_add_epi32(idx, step);
+    }
+    return k + point_scalar(out + k, vals + j, n - j, value, base + j);
+}
+
+__attribute__((target("avx2,popcnt")))
+static
+size_t range_pos_avx2(int *out, const int *pos, const int *vals, size_t n, int low, int high) {
+    const __m256i lo = _mm256_set1_epi32(low);
+    const __m256i hi = _mm256_set1_epi32(high);
+    size_t k = 0, j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (vals + j));
+        __m256i p = _mm256_loadu_si256((const __m256i *) (pos + j));
+        __m256i in = _mm256_andnot_si256(_mm256_cmpgt_epi32(lo, v), _mm256_cmpgt_epi32(hi, v));
+        unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(in));
+        _mm256_storeu_si256((__m256i *) (out + k), compress8(p, mask));
+        k += _mm_popcnt_u32(mask);
+    }
+    return k + range_pos_scalar(out + k, pos + j, vals + j, n - j, low, high);
+}
+
+/* bitmap kernels gather the movemasks of 8 comparisons into one word */
+__attribute__((target("avx2,popcnt")))
+static
+size_t range_bits_avx2(uint64_t *bits, const int *vals, size_t n, int low, int high) {
+    const __m256i lo = _mm256_set1_epi32(low);
+    const __m256i hi = _mm256_set1_epi32(high);
+    size_t count = 0, j = 0;
+    for (; j + 64 <= n; j += 64) {
+        uint64_t word = 0;
+        for (int b = 0; b < 64; b += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i *) (vals + j + b));
+            __m256i in = _mm256_andnot_si256(_mm256_cmpgt_epi32(lo, v), _mm256_cmpgt_epi32(hi, v));
+            word |= (uint64_t) _mm256_movemask_ps(_mm256_castsi256_ps(in)) << b;
+        }
+        bits[j / 64] = word;
+        count += _mm_popcnt_u64(word);
+    }
+    return count + range_bits_scalar(bits + j / 64, vals + j, n - j, low, high);
+}
+
+__attribute__((target("avx2,popcnt")))
+static
+size_t point_bits_avx2(uint64_t *bits, const int *vals, size_t n, int value) {
+    const __m256i x = _mm256_set1_epi32(value);
+    size_t count = 0, j = 0;
+    for (; j + 64 <= n; j += 64) {
+        uint64_t word = 0;
+        for (int b = 0; b < 64; b += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i *) (vals + j + b));
+            word |= (uint64_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, x))) << b;
+        }
+        bits[j / 64] = word;
+        count += _mm_popcnt_u64(word);
+    }
+    return count + point_bits_scalar(bits + j / 64, vals + j, n - j, value);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// AVX-512: comparisons yield a lane mask directly and compress packs the
+// selected lanes. Packing into a register and storing all 16 lanes is
+// faster than a masked compress-store on several cores; it stays within
+// |out| because k <= j.
+
+__attribute__((target("avx512f,popcnt")))
+static
+size_t range_avx512(int *out, const int *vals, size_t n, int low, int high, int base) {
+    const __m512i lo = _mm512_set1_epi32(low);
+    const __m512i hi = _mm512_set1_epi32(high);
+    const __m512i step = _mm512_set1_epi32(16);
+    __m512i idx = _mm512_add_epi32(_mm512_set1_epi32(base),
+                                   _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                                     8, 9, 10, 11, 12, 13, 14, 15));
+    size_t k = 0, j = 0;
+    for (; j + 16 <= n; j += 16) {
+        __m512i v = _mm512_loadu_si512(vals + j);
+        __mmask16 mask = _mm512_mask_cmplt_epi32_mask(_mm512_cmpge_epi32_mask(v, lo), v, hi);
+        _mm512_storeu_si512(out + k, _mm512_maskz_compress_epi32(mask, idx));
+        k += _mm_popcnt_u32(mask);
+        idx = _mm512_add_epi32(idx, step);
+    }
+    return k + range_scalar(out + k, vals + j, n - j, low, high, base + j);
+}
+
+__attribute__((target("avx512f,popcnt")))
+static
+size_t point_avx512(int *out, const int *vals, size_t n, int value, int base) {
+    const __m512i x = _mm512_set1_epi32(value);
+    const __m512i step = _mm512_set1_epi32(16);
+    __m512i idx = _mm512_add_epi32(_mm512_set1_epi32(base),
+                                   _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                                     8, 9, 10, 11, 12, 13, 14, 15));
+    size_t k = 0, j = 0;
+    for (; j + 16 <= n; j += 16) {
+        __m512i v = _mm512_loadu_si512(vals + j);
+        __mmask16 mask = _mm512_cmpeq_epi32_mask(v, x);
+        if (mask) {
+            _mm512_storeu_si512(out + k, _mm512_maskz_compress_epi32(mask, idx));
+            k += _mm_popcnt_u32(mask);
+        }
+        idx = _mm512_add_epi32(idx, step);
+    }
+    return k + point_scalar(out + k, vals + j, n - j, value, base + j);
+}
+
+__attribute__((target("avx512f,popcnt")))
+static
+size_t range_pos_avx512(int *out, const int *pos, const int *vals, size_t n, int low, int high) {
+    const __m512i lo = _mm512_set1_epi32(low);
+    const __m512i hi = _mm512_set1_epi32(high);
+    size_t k = 0, j = 0;
+    for (; j + 16 <= n; j += 16) {
+        __m512i v = _mm512_loadu_si512(vals + j);
+        __m512i p = _mm512_loadu_si512(pos + j);
+        __mmask16 mask = _mm512_mask_cmplt_epi32_mask(_mm512_cmpge_epi32_mask(v, lo), v, hi);
+        _mm512_storeu_si512(out + k, _mm512_maskz_compress_epi32(mask, p));
+        k += _mm_popcnt_u32(mask);
+    }
+    return k + range_pos_scalar(out + k, pos + j, vals + j, n - j, low, high);
+}
+
+/* four 16-lane comparison masks make a word */
+__attribute__((target("avx512f,popcnt")))
+static
+size_t range_bits_avx512(uint64_t *bits, const int *vals, size_t n, int low, int high) {
+    const __m512i lo = _mm512_set1_epi32(low);
+    const __m512i hi = _mm512_set1_epi32(high);
+    size_t count = 0, j = 0;
+    for (; j + 64 <= n; j += 64) {
+        uint64_t word = 0;
+        for (int b = 0; b < 64; b += 16) {
+            __m512i v = _mm512_loadu_si512(vals + j + b);
+            __mmask16 mask = _mm512_mask_cmplt_epi32_mask(_mm512_cmpge_epi32_mask(v, lo), v, hi);
+            word |= (uint64_t) mask << b;
+        }
+        bits[j / 64] = word;
+        count += _mm_popcnt_u64(word);
+    }
+    return count + range_bits_scalar(bits + j / 64, vals + j, n - j, low, high);
+}
+
+__attribute__((target("avx512f,popcnt")))
+static
+size_t point_bits_avx512(uint64_t *bits, const int *vals, size_t n, int value) {
+    const __m512i x = _mm512_set1_epi32(value);
+    size_t count = 0, j = 0;
+    for (; j + 64 <= n; j += 64) {
+        uint64_t word = 0;
+        for (int b = 0; b < 64; b += 16) {
+            __m512i v = _mm512_loadu_si512(vals + j + b);
+            word |= (uint64_t) _mm512_cmpeq_epi32_mask(v, x) << b;
+        }
+        bits[j / 64] = word;
+        count += _mm_popcnt_u64(word);
+    }
+    return count + point_bits_scalar(bits + j / 64, vals + j, n - j, value);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Aggregation: four independent accumulators, so a min, max or add does not
+// wait on the previous one. Sums of ints widen to 64 bits before adding.
+
+#define MIN(a, b) (((b) < (a)) ? (b) : (a))
+#define MAX(a, b) (((b) > (a)) ? (b) : (a))
+
+static
+int min_generic(const int *vals, size_t n) {
+    int m0 = vals[0], m1 = m0, m2 = m0, m3 = m0;
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        m0 = MIN(m0, vals[j]);
+        m1 = MIN(m1, vals[j + 1]);
+        m2 = MIN(m2, vals[j + 2]);
+        m3 = MIN(m3, vals[j + 3]);
+    }
+    for (; j < n; j++) m0 = MIN(m0, vals[j]);
+    return MIN(MIN(m0, m1), MIN(m2, m3));
+}
+
+static
+int max_generic(const int *vals, size_t n) {
+    int m0 = vals[0], m1 = m0, m2 = m0, m3 = m0;
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        m0 = MAX(m0, vals[j]);
+        m1 = MAX(m1, vals[j + 1]);
+        m2 = MAX(m2, vals[j + 2]);
+        m3 = MAX(m3, vals[j + 3]);
+    }
+    for (; j < n; j++) m0 = MAX(m0, vals[j]);
+    return MAX(MAX(m0, m1), MAX(m2, m3));
+}
+
+static
+long int sum_generic(const int *vals, size_t n) {
+    long int s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        s0 += vals[j];
+        s1 += vals[j + 1];
+        s2 += vals[j + 2];
+        s3 += vals[j + 3];
+    }
+    for (; j < n; j++) s0 += vals[j];
+    return s0 + s1 + s2 + s3;
+}
+
+static
+long int min_long_generic(const long int *vals, size_t n) {
+    long int m0 = vals[0], m1 = m0, m2 = m0, m3 = m0;
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        m0 = MIN(m0, vals[j]);
+        m1 = MIN(m1, vals[j + 1]);
+        m2 = MIN(m2, vals[j + 2]);
+        m3 = MIN(m3, vals[j + 3]);
+    }
+    for (; j < n; j++) m0 = MIN(m0, vals[j]);
+    return MIN(MIN(m0, m1), MIN(m2, m3));
+}
+
+static
+long int max_long_generic(const long int *vals, size_t n) {
+    long int m0 = vals[0], m1 = m0, m2 = m0, m3 = m0;
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        m0 = MAX(m0, vals[j]);
+        m1 = MAX(m1, vals[j + 1]);
+        m2 = MAX(m2, vals[j + 2]);
+        m3 = MAX(m3, vals[j + 3]);
+    }
+    for (; j < n; j++) m0 = MAX(m0, vals[j]);
+    return MAX(MAX(m0, m1), MAX(m2, m3));
+}
+
+static
+__int128 sum_long_generic(const long int *vals, size_t n) {
+    __int128 s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t j = 0;
+    for (; j + 4 <= n; j += 4) {
+        s0 += vals[j];
+        s1 += vals[j + 1];
+        s2 += vals[j + 2];
+        s3 += vals[j + 3];
+    }
+    for (; j < n; j++) s0 += vals[j];
+    return s0 + s1 + s2 + s3;
+}
+
+/* AVX2 lacks 64-bit min and max: they compare and blend */
+__attribute__((target("avx2")))
+static inline
+__m256i min_epi64(__m256i a, __m256i b) {
+    return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+}
+
+__attribute__((target("avx2")))
+static inline
+__m256i max_epi64(__m256i a, __m256i b) {
+    return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b));
+}
+
+__attribute__((target("avx2")))
+static
+int min_avx2(const int *vals, size_t n) {
+    if (n < 32) return min_generic(vals, n);
+    __m256i m0 = _mm256_loadu_si256((const __m256i *) vals), m1 = m0, m2 = m0, m3 = m0;
+    size_t j = 0;
+    for (; j + 32 <= n; j += 32) {
+        m0 = _mm256_min_epi32(m0, _mm256_loadu_si256((const __m256i *) (vals + j)));
+        m1 = _mm256_min_epi32(m1, _mm256_loadu_si256((const __m256i *) (vals + j + 8)));
+        m2 = _mm256_min_epi32(m2, _mm256_loadu_si256((const __m256i *) (vals + j + 16)));
+        m3 = _mm256_min_epi32(m3, _mm256_loadu_si256((const __m256i *) (vals + j + 24)));
+    }
+    int lanes[8];
+    _mm256_storeu_si256((__m256i *) lanes,
+                        _mm256_min_epi32(_mm256_min_epi32(m0, m1), _mm256_min_epi32(m2, m3)));
+    int m = min_generic(lanes, 8);
+    return (j < n) ? MIN(m, min_generic(vals + j, n - j)) : m;
+}
+
+__attribute__((target("avx2")))
+static
+int max_avx2(const int *vals, size_t n) {
+    if (n < 32) return max_generic(vals, n);
+    __m256i m0 = _mm256_loadu_si256((const __m256i *) vals), m1 = m0, m2 = m0, m3 = m0;
+    size_t j = 0;
+    for (; j + 32 <= n; j += 32) {
+        m0 = _mm256_max_epi32(m0, _mm256_loadu_si256((const __m256i *) (vals + j)));
+        m1 = _mm256_max_epi32(m1, _mm256_loadu_si256((const __m256i *) (vals + j + 8)));
+        m2 = _mm256_max_epi32(m2, _mm256_loadu_si256((const __m256i *) (vals + j + 16)));
+        m3 = _mm256_max_epi32(m3, _mm256_loadu_si256((const __m256i *) (vals + j + 24)));
+    }
+    int lanes[8];
+    _mm256_storeu_si256((__m256i *) lanes,
+                        _mm256_max_epi32(_mm256_max_epi32(m0, m1), _mm256_max_epi32(m2, m3)));
+    int m = max_generic(lanes, 8);
+    return (j < n) ? MAX(m, max_generic(vals + j, n - j)) : m;
+}
+
+__attribute__((target("avx2")))
+static
+long int sum_avx2(const int *vals, size_t n) {
+    __m256i s0 = _mm256_setzero_si256(), s1 = s0, s2 = s0, s3 = s0;
+    size_t j = 0;
+    for (; j + 16 <= n; j += 16) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *) (vals + j));
+        __m256i v1 = _mm256_loadu_si256((const __m256i *) (vals + j + 8));
+        s0 = _mm256_add_epi64(s0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v0)));
+        s1 = _mm256_add_epi64(s1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v0, 1)));
+        s2 = _mm256_add_epi64(s2, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v1)));
+        s3 = _mm256_add_epi64(s3, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v1, 1)));
+    }
+    long int lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes,
+                        _mm256_add_epi64(_mm256_add_epi64(s0, s1), _mm256_add_epi64(s2, s3)));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_generic(vals + j, n - j);
+}
+
+__attribute__((target("avx2")))
+static
+long int min_long_avx2(const long int *vals, size_t n) {
+    if (n < 16) return min_long_generic(vals, n);
+    __m256i m0 = _mm256_loadu_si256((const __m256i *) vals), m1 = m0, m2 = m0, m3 = m0;
+    size_t j = 0;
+    for (; j + 16 <= n; j += 16) {
+        m0 = min_epi64(m0, _mm256_loadu_si256((const __m256i *) (vals + j)));
+        m1 = min_epi64(m1, _mm256_loadu_si256((const __m256i *) (vals + j + 4)));
+        m2 = min_epi64(m2, _mm256_loadu_si256((const __m256i *) (vals + j + 8)));
+        m3 = min_epi64(m3, _mm256_loadu_si256((const __m256i *) (vals + j + 12)));
+    }
+    long int lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, min_epi64(min_epi64(m0, m1), min_epi64(m2, m3)));
+    long int m = min_long_generic(lanes, 4);
+    return (j < n) ? MIN(m, min_long_generic(vals + j, n - j)) : m;
+}
+
+__attribute__((target("avx2")))
+static
+long int max_long_avx2(const long int *vals, size_t n) {
+    if (n < 16) return max_long_generic(vals, n);
+    __m256i m0 = _mm256_loadu_si256((const __m256i *) vals), m1 = m0, m2 = m0, m3 = m0;
+    size_t j = 0;
+    for (; j + 16 <= n; j += 16) {
+        m0 = max_epi64(m0, _mm256_loadu_si256((const __m256i *) (vals + j)));
+        m1 = max_epi64(m1, _mm256_loadu_si256((const __m256i *) (vals + j + 4)));
+        m2 = max_epi64(m2, _mm256_loadu_si256((const __m256i *) (vals + j + 8)));
+        m3 = max_epi64(m3, _mm256_loadu_si256((const __m256i *) (vals + j + 12)));
+    }
+    long int lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, max_epi64(max_epi64(m0, m1), max_epi64(m2, m3)));
+    long int m = max_long_generic(lanes, 4);
+    return (j < n) ? MAX(m, max_long_generic(vals + j, n - j)) : m;
+}
+
+/*
+ * A sum of longs overflows 64-bit lanes, so the vector kernels add the low
+ * and the high 32 bits of the values apart, each lane exact for 2^32
+ * values, and combine them in 128 bits. AVX2 has no arithmetic 64-bit
+ * shift: it takes the high bits unsigned and counts the negative values,
+ * which that reads as v + 2^64.
+ */
+static inline
+__int128 wide_total(const uint64_t *lo, const uint64_t *hi, const uint64_t *neg, size_t lanes) {
+    __int128 s = 0;
+    for (size_t k = 0; k < lanes; k++)
+        s += (__int128) lo[k] + ((__int128) hi[k] << 32) - ((__int128) neg[k] << 64);
+    return s;
+}
+
+__attribute__((target("avx2")))
+static
+__int128 sum_long_avx2(const long int *vals, size_t n) {
+    const __m256i zero = _mm256_setzero_si256(), mask = _mm256_set1_epi64x(0xffffffff);
+    __m256i lo0 = zero, lo1 = zero, hi0 = zero, hi1 = zero, neg0 = zero, neg1 = zero;
+    size_t j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *) (vals + j));
+        __m256i v1 = _mm256_loadu_si256((const __m256i *) (vals + j + 4));
+        lo0 = _mm256_add_epi64(lo0, _mm256_and_si256(v0, mask));
+        lo1 = _mm256_add_epi64(lo1, _mm256_and_si256(v1, mask));
+        hi0 = _mm256_add_epi64(hi0, _mm256_srli_epi64(v0, 32));
+        hi1 = _mm256_add_epi64(hi1, _mm256_srli_epi64(v1, 32));
+        neg0 = _mm256_sub_epi64(neg0, _mm256_cmpgt_epi64(zero, v0));
+        neg1 = _mm256_sub_epi64(neg1, _mm256_cmpgt_epi64(zero, v1));
+    }
+    uint64_t lo[8], hi[8], neg[8];
+    _mm256_storeu_si256((__m256i *) lo, lo0);
+    _mm256_storeu_si256((__m256i *) (lo + 4), lo1);
+    _mm256_storeu_si256((__m256i *) hi, hi0);
+    _mm256_storeu_si256((__m256i *) (hi + 4), hi1);
+    _mm256_storeu_si256((__m256i *) neg, neg0);
+    _mm256_storeu_si256((__m256i *) (neg + 4), neg1);
+    return wide_total(lo, hi, neg, 8) + sum_long_generic(vals + j, n - j);
+}
+
+__attribute__((target("avx512f")))
+static
+int min_avx512(const int *vals, size_t n) {
+    if (n < 64) return min_generic(vals, n);
+    __m512i m0 = _mm512_loadu_si512(vals), m1 = m0, m2 = m0, m3 = m0;
+    size_t j = 0;
+    for (; j + 64 <= n; j += 64) {
+        m0 = _mm512_min_epi32(m0, _mm512_loadu_si512(vals + j));
+        m1 = _mm512_min_epi32(m1, _mm512_loadu_si512(vals + j + 16));
+        m2 = _mm512_min_epi32(m2, _mm512_loadu_si512(vals + j + 32));
+        m3 = _mm512_min_epi32(m3, _mm512_loadu_si512(vals + j + 48));
+    }
+    int m = _mm512_reduce_min_epi32(_mm512_min_epi32(_mm512_min_epi32(m0, m1),
+                                                     _mm512_min_epi32(m2, m3)));
+    return (j < n) ? MIN(m, min_generic(vals + j, n - j)) : m;
+}
+
+__attribute__((target("avx512f")))
+static
+int max_avx512(const int *vals, size_t n) {
+    if (n < 64) return max_generic(vals, n);
+    __m512i m0 = _mm512_loadu_si512(vals), m1 = m0, m2 = m0, m3 = m0;
+    size_t j = 0;
+    for (; j + 64 <= n; j += 64) {
+        m0 = _mm512_max_epi32(m0, _mm512_loadu_si512(vals + j));
+        m1 = _mm512_max_epi32(m1, _mm512_loadu_si512(vals + j + 16));
+        m2 = _mm512_max_epi32(m2, _mm512_loadu_si512(vals + j + 32));
+        m3 = _mm512_max_epi32(m3, _mm512_loadu_si512(vals + j + 48));
+    }
+    int m = _mm512_reduce_max_epi32(_mm512_max_epi32(_mm512_max_epi32(m0, m1),
+                                                     _mm512_max_epi32(m2, m3)));
+    return (j < n) ? MAX(m, max_generic(vals + j, n - j)) : m;
+}
+
+__attribute__((target("avx512f")))
+static
+long int sum_avx512(const int *vals, size_t n) {
+    __m512i s0 = _mm512_setzero_si512(), s1 = s0, s2 = s0, s3 = s0;
+    size_t j = 0;
+    for (; j + 32 <= n; j += 32) {
+        s0 = _mm512_add_epi64(s0, _mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i *) (vals + j))));
+        s1 = _mm512_add_epi64(s1, _mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i *) (vals + j + 8))));
+        s2 = _mm512_add_epi64(s2, _mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i *) (vals + j + 16))));
+        s3 = _mm512_add_epi64(s3, _mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i *) (vals + j + 24))));
+    }
+    return _mm512_reduce_add_epi64(_mm512_add_epi64(_mm512_add_epi64(s0, s1), _mm512_add_epi64(s2, s3)))
+        + sum_generic(vals + j, n - j);
+}
+
+__attribute__((target("avx512f")))
+static
+long int min_long_avx512(const long int *vals, size_t n) {
+    if (n < 32) return min_long_generic(vals, n);
+    __m512i m0 = _mm512_loadu_si512(vals), m1 = m0, m2 = m0, m3 = m0;
+    size_t j = 0;
+    for (; j + 32 <= n; j += 32) {
+        m0 = _mm512_min_epi64(m0, _mm512_loadu_si512(vals + j));
+        m1 = _mm512_min_epi64(m1, _mm512_loadu_si512(vals + j + 8));
+        m2 = _mm512_min_epi64(m2, _mm512_loadu_si512(vals + j + 16));
+        m3 = _mm512_min_epi64(m3, _mm512_loadu_si512(vals + j + 24));
+    }
+    long int m = _mm512_reduce_min_epi64(_mm512_min_epi64(_mm512_min_epi64(m0, m1),
+                                                          _mm512_min_epi64(m2, m3)));
+    return (j < n) ? MIN(m, min_long_generic(vals + j, n - j)) : m;
+}
+
+__attribute__((target("avx512f")))
+static
+long int max_long_avx512(const long int *vals, size_t n) {
+    if (n < 32) return max_long_generic(vals, n);
+    __m512i m0 = _mm512_loadu_si512(vals), m1 = m0, m2 = m0, m3 = m0;
+    size_t j = 0;
+    for (; j + 32 <= n; j += 32) {
+        m0 = _mm512_max_epi64(m0, _mm512_loadu_si512(vals + j));
+        m1 = _mm512_max_epi64(m1, _mm512_loadu_si512(vals + j + 8));
+        m2 = _mm512_max_epi64(m2, _mm512_loadu_si512(vals + j + 16));
+        m3 = _mm512_max_epi64(m3, _mm512_loadu_si512(vals + j + 24));
+    }
+    long int m = _mm512_reduce_max_epi64(_mm512_max_epi64(_mm512_max_epi64(m0, m1),
+                                                          _mm512_max_epi64(m2, m3)));
+    return (j < n) ? MAX(m, max_long_generic(vals + j, n - j)) : m;
+}
+
+__attribute__((target("avx512f")))
+static
+__int128 sum_long_avx512(const long int *vals, size_t n) {
+    const __m512i zero = _mm512_setzero_si512(), mask = _mm512_set1_epi64(0xffffffff);
+    __m512i lo0 = zero, lo1 = zero, hi0 = zero, hi1 = zero;
+    size_t j = 0;
+    for (; j + 16 <= n; j += 16) {
+        __m512i v0 = _mm512_loadu_si512(vals + j);
+        __m512i v1 = _mm512_loadu_si512(vals + j + 8);
+        lo0 = _mm512_add_epi64(lo0, _mm512_and_si512(v0, mask));
+        lo1 = _mm512_add_epi64(lo1, _mm512_and_si512(v1, mask));
+        hi0 = _mm512_add_epi64(hi0, _mm512_srai_epi64(v0, 32));
+        hi1 = _mm512_add_epi64(hi1, _mm512_srai_epi64(v1, 32));
+    }
+    uint64_t lo[16];
+    int64_t hi[16];             // signed: no negative value needs counting
+    _mm512_storeu_si512(lo, lo0);
+    _mm512_storeu_si512(lo + 8, lo1);
+    _mm512_storeu_si512(hi, hi0);
+    _mm512_storeu_si512(hi + 8, hi1);
+    __int128 s = 0;
+    for (size_t k = 0; k < 16; k++)
+        s += (__int128) lo[k] + ((__int128) hi[k] << 32);
+    return s + sum_long_generic(vals + j, n - j);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static range_fn range_impl = range_generic;
+static point_fn point_impl = point_generic;
+static range_pos_fn range_pos_impl = range_pos_generic;
+static range_bits_fn range_bits_impl = range_bits_generic;
+static point_bits_fn point_bits_impl = point_bits_generic;
+static agg_fn min_impl = min_generic;
+static agg_fn max_impl = max_generic;
+static sum_fn sum_impl = sum_generic;
+static agg_long_fn min_long_impl = min_long_generic;
+static agg_long_fn max_long_impl = max_long_generic;
+static sum_long_fn sum_long_impl = sum_long_generic;
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+
+static
+void dispatch_init(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("popcnt")) {
+        range_impl = range_avx512;
+        point_impl = point_avx512;
+        range_pos_impl = range_pos_avx512;
+        range_bits_impl = range_bits_avx512;
+        point_bits_impl = point_bits_avx512;
+        min_impl = min_avx512;
+        max_impl = max_avx512;
+        sum_impl = sum_avx512;
+        min_long_impl = min_long_avx512;
+        max_long_impl = max_long_avx512;
+        sum_long_impl = sum_long_avx512;
+        log_info("simd: using avx512 kernels\n");
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        perm_init();
+        range_impl = range_avx2;
+        point_impl = point_avx2;
+        range_pos_impl = range_pos_avx2;
+        range_bits_impl = range_bits_avx2;
+        point_bits_impl = point_bits_avx2;
+        min_impl = min_avx2;
+        max_impl = max_avx2;
+        sum_impl = sum_avx2;
+        min_long_impl = min_long_avx2;
+        max_long_impl = max_long_avx2;
+        sum_long_impl = sum_long_avx2;
+        log_info("simd: using avx2 kernels\n");
+    }
+}
+
+size_t simd_range(int *out, const int *vals, size_t n, int low, int high, int base) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return range_impl(out, vals, n, low, high, base);
+}
+
+size_t simd_point(int *out, const int *vals, size_t n, int value, int base) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return point_impl(out, vals, n, value, base);
+}
+
+size_t simd_range_pos(int *out, const int *pos, const int *vals, size_t n,
+                      int low, int high) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return range_pos_impl(out, pos, vals, n, low, high);
+}
+
+size_t simd_range_bits(uint64_t *bits, const int *vals, size_t n, int low, int high) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return range_bits_impl(bits, vals, n, low, high);
+}
+
+size_t simd_point_bits(uint64_t *bits, const int *vals, size_t n, int value) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return point_bits_impl(bits, vals, n, value);
+}
+
+int simd_min(const int *vals, size_t n) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return min_impl(vals, n);
+}
+
+int simd_max(const int *vals, size_t n) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return max_impl(vals, n);
+}
+
+long int simd_sum(const int *vals, size_t n) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return sum_impl(vals, n);
+}
+
+long int simd_min_long(const long int *vals, size_t n) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return min_long_impl(vals, n);
+}
+
+long int simd_max_long(const long int *vals, size_t n) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return max_long_impl(vals, n);
+}
+
+__int128 simd_sum_long(const long int *vals, size_t n) {
+    pthread_once(&dispatch_once, dispatch_init);
+    return sum_long_impl(vals, n);
+}
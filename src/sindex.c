@@ -128,13 +128,23 @@ int sindex_of_right(struct sindex *a, int right_range, int length) {
     return low - 1;
 }
 
-size_t sindex_scan(int **v, int low, int high, size_t sz, struct sindex *idx) {
-    int low_idx = sindex_of_left(idx, low, sz);
-    int high_idx = sindex_of_right(idx, high, sz);
-    //bool flag = low_idx == -1 || high_idx == -1 || low_idx > high_idx;
+/* the number of entries with low <= val < high, from |*first| on */
+static
+size_t sindex_bounds(struct sindex *idx, int low, long int high, size_t sz, int *first) {
+    int low_idx = (sz && low < high) ? sindex_of_left(idx, low, sz) : -1;
+    int high_idx = (sz && low < high) ? sindex_of_right(idx, high - 1, sz) : -1;
+    *first = low_idx;
+    return (low_idx == -1 || low_idx > high_idx) ? 0 : high_idx - low_idx + 1;
+}
+
+size_t sindex_count(int low, long int high, size_t sz, struct sindex *idx) {
+    int first;
+    return sindex_bounds(idx, low, high, sz, &first);
+}
 
-    //size_t num_tuples = flag ? 0 : high_idx - low_idx + 1;
-    size_t num_tuples = low_idx > high_idx ? 0 : high_idx - low_idx + 1;
+size_t sindex_scan(int **v, int low, long int high, size_t sz, struct sindex *idx) {
+    int low_idx;
+    size_t num_tuples = sindex_bounds(idx, low, high, sz, &low_idx);
     int *vec = malloc(num_tuples * sizeof *vec);
 
     for (size_t j = 0, k = low_idx; j < num_tuples; j++)
@@ -194,3 +204,26 @@ size_t sindex_find(int **v, int value, size_t sz, struct sindex *idx) {
     *v = vec;
     return num_tuples;
 }
+
+/*
+ * first[j] = the first entry with a value of at least keys[j], for |n|
+ * keys. The searches halve their ranges in step and each prefetches its
+ * next probe, so the misses of a batch overlap.
+ */
+void sindex_lower_batch(struct sindex const *idx, size_t sz, const int *keys, size_t n,
+                        size_t *first) {
+    for (size_t j = 0; j < n; j++) first[j] = 0;
+    if (sz == 0) return;
+
+    size_t len = sz;
+    while (len > 1) {
+        size_t half = len / 2;
+        for (size_t j = 0; j < n; j++) {
+            first[j] += (idx[first[j] + half].val < keys[j]) ? half : 0;
+            __builtin_prefetch(&idx[first[j] + (len - half) / 2]);
+        }
+        len -= half;
+    }
+    for (size_t j = 0; j < n; j++)
+        first[j] += (idx[first[j]].val < keys[j]);
+}
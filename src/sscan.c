@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sscan.h"
+#include "simd.h"
+#include "bitmap.h"
+#include "tpool.h"
+#include "utils.h"
+
+/* values per block: 16KB stays in L1 while every predicate is applied to it */
+#define SSCAN_BLOCK 4096
+/* below this a second pass over the column costs more than it saves */
+#define SSCAN_PARALLEL_MIN (1 << 16)
+/* values per morsel: the unit of work of a parallel scan */
+#define SSCAN_MORSEL (1 << 14)
+
+struct sscan_task {
+    struct scanq *qs;
+    size_t nq;
+    const int *vals;
+    size_t sz;
+};
+
+static inline
+size_t sscan_kernel(struct scanq *q, uint64_t *bits, const int *vals, size_t len) {
+    return (q->point) ? simd_point_bits(bits, vals, len, q->low)
+                      : simd_range_bits(bits, vals, len, q->low, q->high);
+}
+
+/* what the zone map and the Bloom filter of zone |zone| tell about |q| */
+enum zone_match sscan_zone(struct scanq const *q, size_t zone) {
+    enum zone_match m = ZONE_SOME;
+    if (q->zones) {
+        const struct zone *z = &q->zones[zone];
+        m = (q->point) ? zone_point(z, q->low) : zone_range(z, q->low, q->high);
+    }
+    if (m == ZONE_SOME && q->point && q->bloom && !bloom_test(q->bloom, zone, q->low))
+        m = ZONE_NONE;
+    return m;
+}
+
+/*
+ * Sets the bits of the positions base + j of |vals| qualifying for |q| and
+ * returns how many there are. |base| is a multiple of 64, so blocks write
+ * disjoint words of q->bits; with a zone map or Bloom filters it is a
+ * multiple of ZONE_SIZE and zones that cannot or must all qualify are
+ * decided without a scan.
+ */
+size_t sscan_block(struct scanq *q, const int *vals, size_t base, size_t len) {
+    assert(base % 64 == 0);
+    if (q->zones == NULL && q->bloom == NULL)
+        return sscan_kernel(q, q->bits + base / 64, vals, len);
+
+    assert(base % ZONE_SIZE == 0);
+    size_t count = 0;
+    for (size_t off = 0; off < len; off += ZONE_SIZE) {
+        size_t n = (len - off < ZONE_SIZE) ? len - off : ZONE_SIZE;
+        uint64_t *bits = q->bits + (base + off) / 64;
+        switch (sscan_zone(q, (base + off) / ZONE_SIZE)) {
+            case ZONE_NONE:
+                memset(bits, 0, BITMAP_WORDS(n) * sizeof *bits);
+                break;
+            case ZONE_ALL:
+                count += bitmap_fill(bits, n);
+                break;
+            case ZONE_SOME:
+                count += sscan_kernel(q, bits, vals + off, n);
+                break;
+        }
+    }
+    return count;
+}
+
+/* one pass over the column applying every predicate of the group per block */
+static
+void sscan_group(void *arg) {
+    struct sscan_task *t = arg;
+    for (size_t base = 0; base < t->sz; base += SSCAN_BLOCK) {
+        size_t len = (t->sz - base < SSCAN_BLOCK) ? t->sz - base : SSCAN_BLOCK;
+        for (size_t i = 0; i < t->nq; i++)
+            t->qs[i].num_tuples += sscan_block(&t->qs[i], t->vals + base, base, len);
+    }
+}
+
+/*
+ * Evaluates the selects |qs| over the same column |vals| of |sz| values.
+ * Queries are split into groups, one per available thread, and every group
+ * makes a single cache-resident pass over the column.
+ */
+void shared_scan(struct scanq *qs, size_t nq, const int *vals, size_t sz) {
+    struct tpool *tp = exec_pool();
+    size_t ngroups = tpool_tasks(tp, sz, SSCAN_PARALLEL_MIN);
+    if (ngroups > nq) ngroups = nq;
+    if (ngroups == 0) return;
+
+    struct sscan_task tasks[ngroups];
+    size_t per_group = nq / ngroups, rem = nq % ngroups, first = 0;
+    for (size_t g = 0; g < ngroups; g++) {
+        tasks[g].qs = qs + first;
+        tasks[g].nq = per_group + (g < rem);
+        tasks[g].vals = vals;
+        tasks[g].sz = sz;
+        first += tasks[g].nq;
+    }
+
+    tpool_run(tp, sscan_group, tasks, ngroups, sizeof *tasks);
+
+    cs165_log(stderr, "shared_scan: %zu queries in %zu groups\n", nq, ngroups);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+struct morsel {
+    struct scanq *const *qs;
+    size_t nq;
+    const int *vals;
+    size_t base;
+    size_t len;
+    size_t *counts;	// qualifying positions per query
+};
+
+static
+void scan_morsel(void *arg) {
+    struct morsel *m = arg;
+    for (size_t i = 0; i < m->nq; i++)
+	m->counts[i] = sscan_block(m->qs[i], m->vals + m->base, m->base, m->len);
+}
+
+/*
+ * Marks for each of the |nq| selects the qualifying positions among
+ * vals[base, base + len). The range is cut into morsels that the execution
+ * pool takes in any order; morsels are word aligned, so each one writes its
+ * own part of the bitmaps and nothing needs stitching.
+ */
+void morsel_scan(struct scanq *const *qs, size_t nq, const int *vals, size_t base, size_t len) {
+    struct tpool *tp = exec_pool();
+    size_t nm = (len + SSCAN_MORSEL - 1) / SSCAN_MORSEL;
+
+    if (tp == NULL || nm < 2) {
+	for (size_t i = 0; i < nq; i++)
+	    qs[i]->num_tuples += sscan_block(qs[i], vals + base, base, len);
+	return;
+    }
+
+    struct morsel *ms = malloc(nm * sizeof *ms);
+    size_t *counts = malloc(nm * nq * sizeof *counts);
+    assert(ms && counts);
+    for (size_t m = 0; m < nm; m++) {
+	ms[m].qs = qs;
+	ms[m].nq = nq;
+	ms[m].vals = vals;
+	ms[m].base = base + m * SSCAN_MORSEL;
+	ms[m].len = (m == nm - 1) ? len - m * SSCAN_MORSEL : SSCAN_MORSEL;
+	ms[m].counts = counts + m * nq;
+    }
+
+    tpool_run(tp, scan_morsel, ms, nm, sizeof *ms);
+
+    for (size_t m = 0; m < nm; m++)
+	for (size_t i = 0; i < nq; i++)
+	    qs[i]->num_tuples += ms[m].counts[i];
+
+    free(counts);
+    free(ms);
+}
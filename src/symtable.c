@@ -1,35 +1,65 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include "symtable.h"
 #include "utils.h"
 #include "sfhash.h"
 #include "cs165_api.h"
+#include "cvec.h"
 
 /** Symbol hash table for variables **/
 #define VAR_MAP_SIZE 1024
+#define SCOPE_MAP_SIZE 64
 
-static struct {
-    size_t num_elems;
-    size_t capacity;
-    struct element {
-        uint64_t keyhash;
-        char *key;
-        enum vartype keytype;
-        void *value;
-    } *data;
-} var_map[VAR_MAP_SIZE];
+struct varmap {
+    size_t size;
+    struct bucket {
+        size_t num_elems;
+        size_t capacity;
+        struct element {
+            uint64_t keyhash;
+            char *key;
+            enum vartype keytype;
+            void *value;
+        } *data;
+    } *buckets;
+};
+
+/*
+ * Database entities (tables, columns) are shared by every client and live in
+ * the global map. Results are private to a client session: each session owns
+ * a symtable and installs it as the scope of the thread that parses or
+ * executes its queries. Names are looked up in the scope first.
+ */
+struct symtable {
+    struct varmap vars;
+};
+
+static struct bucket global_buckets[VAR_MAP_SIZE];
+static struct varmap globals = { VAR_MAP_SIZE, global_buckets };
+
+/* the event loop resolves names while workers create entities */
+static pthread_rwlock_t globals_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static _Thread_local struct symtable *scope;
+
+static inline
+uint64_t get_keyhash(const char *var) {
+    uint64_t keyhash = 0;
+    memcpy(&keyhash, var, strnlen(var, sizeof keyhash));
+    return keyhash;
+}
 
 static
-struct element *map_find(const char *var) {
-    size_t idx = super_fast_hash(var, strlen(var)) % VAR_MAP_SIZE;
-    size_t num_elements = var_map[idx].num_elems;
-    uint64_t var_hash = 0;
-    strncpy((char *) &var_hash, var, sizeof var_hash);
+struct element *varmap_find(struct varmap *m, const char *var) {
+    size_t idx = super_fast_hash(var, strlen(var)) % m->size;
+    size_t num_elements = m->buckets[idx].num_elems;
+    uint64_t var_hash = get_keyhash(var);
     //cs165_log(stderr, "search for %s -> %lu in %d\n", var, var_hash, idx);
     for (size_t i = 0; i < num_elements; i++) {
-        struct element *e = &var_map[idx].data[i];
+        struct element *e = &m->buckets[idx].data[i];
         //cs165_log(stderr, "check %s -> %lu with value %p\n", e->key, e->keyhash, e->value);
         if (e->keyhash == var_hash && !strcmp(e->key, var))
             return e;
@@ -38,56 +68,148 @@ struct element *map_find(const char *var) {
     return NULL;
 }
 
+static inline
+void release_value(struct element *e) {
+    if (e->keytype == RESULT) cvec_release(e->value);
+}
+
+/*
+ * Binding an existing name replaces its value; the replaced result loses a
+ * reference and the already stored key is kept.
+ */
+static
+void varmap_insert(struct varmap *m, char *key, void *value, enum vartype type) {
+    if (type == RESULT) cvec_retain(value);
+
+    struct element *e = varmap_find(m, key);
+    if (e != NULL) {
+        release_value(e);
+        e->value = value;
+        e->keytype = type;
+        free(key);
+        return;
+    }
+
+    size_t idx = super_fast_hash(key, strlen(key)) % m->size;
+    struct bucket *b = &m->buckets[idx];
+    if (b->num_elems >= b->capacity) {
+        size_t new_capacity = b->capacity ? b->capacity * 2 : 8;
+        struct element *data = realloc(b->data, sizeof(struct element) * new_capacity);
+        b->data = data;
+        b->capacity = new_capacity;
+    }
+    e = &b->data[b->num_elems++];
+    e->keyhash = get_keyhash(key);
+    e->value = value;
+    e->key = key;
+    e->keytype = type;
+    //cs165_log(stderr, "inserted %s -> %p in %d with key %lu\n", key, value, idx, keyhash);
+}
+
+static
+bool varmap_remove(struct varmap *m, const char *key) {
+    struct element *e = varmap_find(m, key);
+    if (e == NULL || e->keytype != RESULT) return false;
+
+    size_t idx = super_fast_hash(key, strlen(key)) % m->size;
+    struct bucket *b = &m->buckets[idx];
+    release_value(e);
+    free(e->key);
+    *e = b->data[--b->num_elems];
+    return true;
+}
+
+static
+void varmap_clean(struct varmap *m) {
+    for (size_t i = 0; i < m->size; i++) {
+        for (size_t j = 0; j < m->buckets[i].num_elems; j++) {
+            struct element *e = &m->buckets[i].data[j];
+            free(e->key);
+            release_value(e);
+        }
+        free(m->buckets[i].data);
+        m->buckets[i].data = NULL;
+        m->buckets[i].num_elems = m->buckets[i].capacity = 0;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+struct symtable *symtable_create(void) {
+    struct symtable *st = malloc(sizeof *st);
+    if (st == NULL) return NULL;
+    st->vars.size = SCOPE_MAP_SIZE;
+    st->vars.buckets = calloc(SCOPE_MAP_SIZE, sizeof *st->vars.buckets);
+    if (st->vars.buckets == NULL) {
+        free(st);
+        return NULL;
+    }
+    return st;
+}
+
+/* scope end: every result only reachable from this session is freed */
+void symtable_free(struct symtable *st) {
+    if (st == NULL) return;
+    if (scope == st) scope = NULL;
+    varmap_clean(&st->vars);
+    free(st->vars.buckets);
+    free(st);
+}
+
+void map_set_scope(struct symtable *st) {
+    scope = st;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 void *map_get(const char *key) {
-    struct element *e = map_find(key);
-    return (e) ? e->value : NULL;
+    struct element *e = (scope) ? varmap_find(&scope->vars, key) : NULL;
+    if (e) return e->value;
+
+    pthread_rwlock_rdlock(&globals_lock);
+    e = varmap_find(&globals, key);
+    void *value = (e) ? e->value : NULL;
+    pthread_rwlock_unlock(&globals_lock);
+    return value;
 }
 
 enum vartype map_gettype(const char *key) {
-    struct element *e = map_find(key);
-    return (e) ? e->keytype : INVALID_VARTYPE;
+    struct element *e = (scope) ? varmap_find(&scope->vars, key) : NULL;
+    if (e) return e->keytype;
+
+    pthread_rwlock_rdlock(&globals_lock);
+    e = varmap_find(&globals, key);
+    enum vartype type = (e) ? e->keytype : INVALID_VARTYPE;
+    pthread_rwlock_unlock(&globals_lock);
+    return type;
 }
 
 /*
  * |key| should be malloced in advance (e.x. come from dbo) and not freed
  */
 bool map_insert(char *key, void *value, enum vartype type) {
-    //if (map_find(key) != NULL) return false;
-    size_t idx = super_fast_hash(key, strlen(key)) % VAR_MAP_SIZE;
-    size_t num_elems = var_map[idx].num_elems;
-    size_t capacity = var_map[idx].capacity;
-    if (num_elems >= capacity) {
-        size_t new_capacity = capacity ? capacity * 2 : 8;
-        struct element *data =
-            realloc(var_map[idx].data, sizeof(struct element) * new_capacity);
-        var_map[idx].data = data;
-        var_map[idx].capacity = new_capacity;
+    if (type == RESULT && scope) {
+        varmap_insert(&scope->vars, key, value, type);
+        return true;
     }
-    uint64_t keyhash = 0;
-    strncpy((char *) &keyhash, key, sizeof keyhash);
-    var_map[idx].data[num_elems].keyhash = keyhash;
-    var_map[idx].data[num_elems].value = value;
-    var_map[idx].data[num_elems].key = key;
-    var_map[idx].data[num_elems].keytype = type;
-    var_map[idx].num_elems++;
-    //cs165_log(stderr, "inserted %s -> %p in %d with key %lu\n", key, value, idx, keyhash);
+
+    pthread_rwlock_wrlock(&globals_lock);
+    varmap_insert(&globals, key, value, type);
+    pthread_rwlock_unlock(&globals_lock);
     return true;
 }
 
-static
-void cvec_free(struct cvec *cv) {
-    free(cv->values);
-    free(cv);
+/* drops a result name of the current scope */
+bool map_remove(const char *key) {
+    if (scope) return varmap_remove(&scope->vars, key);
+
+    pthread_rwlock_wrlock(&globals_lock);
+    bool removed = varmap_remove(&globals, key);
+    pthread_rwlock_unlock(&globals_lock);
+    return removed;
 }
 
 void clean_symtbl(void) {
-    for (size_t i = 0; i < VAR_MAP_SIZE; i++) {
-        for (size_t j = 0; j < var_map[i].num_elems; j++) {
-            struct element *e = &var_map[i].data[j];
-            free(e->key);
-            if (e->keytype == RESULT) cvec_free(e->value);
-        }
-        if (var_map[i].num_elems != 0) free(var_map[i].data);
-    }
+    varmap_clean(&globals);
     return;
 }
@@ -9,7 +9,7 @@
 #include <fcntl.h>
 #include <stdarg.h>
 #include <stddef.h>
-#include <assert.h>
+#include <pthread.h>
 
 #include "cs165_api.h"
 #include "vector.h"
@@ -47,6 +47,7 @@ struct col_record {
 
 static inline
 off_t filemap(const char *path, char **map, int prot) {
+    *map = NULL;                // on every error path
     int fd = open(path, O_RDONLY);
     if (fd == -1) {
         perror("Error opening file for writing");
@@ -61,7 +62,8 @@ off_t filemap(const char *path, char **map, int prot) {
 
     *map = mmap(0, s.st_size, prot, MAP_PRIVATE, fd, 0);
     close(fd);
-    if (map == MAP_FAILED) {
+    if (*map == MAP_FAILED) {
+	*map = NULL;
 	perror("Error mmapping the file");
 	return -1;
     }
@@ -167,6 +169,18 @@ void persist_col(struct column *col, const char *tname) {
     cs165_log(stderr, "%s: %s\n", tname, path);
     persist_data(col->data.vals, col->data.sz, sizeof (int), path);
     if (path != buf) free(path);
+
+    path = vbsnprintf(buf, sizeof buf, "%s/%s.%s.zones.bin", DBPATH, tname, col->name);
+    persist_data(col->zones.zones, col->zones.nzones, sizeof (struct zone), path);
+    if (path != buf) free(path);
+
+    path = vbsnprintf(buf, sizeof buf, "%s/%s.%s.bloom.bin", DBPATH, tname, col->name);
+    if (col->bloom.words)
+	persist_data(col->bloom.words, col->bloom.nzones * BLOOM_ZONE_WORDS, sizeof (uint64_t), path);
+    else
+	unlink(path);	// an index replaced the filters
+    if (path != buf) free(path);
+
     if (col->index) persist_index(col, col->table->name);
 }
 
@@ -319,6 +333,8 @@ void clean_db(struct db *db) {
 	for (size_t j = 0; j < tbl->col_count; j++) {
 	    struct column *col = &tbl->col[j];
 	    if (col->data.vals) vector_free(&col->data);
+	    zonemap_free(&col->zones);
+	    bloom_free(&col->bloom);
 	    if (col->index) free_index(col->index->index, col->index->type);
 	    free(col->index);
 	    free(col->name);
@@ -347,7 +363,8 @@ struct column restore_col(char *record, struct table *tbl) {
     struct col_record *rec = (struct col_record *) record;
     bool clustered = tbl->clustered == tbl->col_count;
     struct column col = { .name = strdup(rec->name), .table = tbl, .index = NULL,
-			  .clustered = clustered, .status = ONDISK, .data = { 0, 0, NULL } };
+			  .clustered = clustered, .status = ONDISK, .data = { 0, 0, NULL },
+			  .zones = { 0, 0, NULL }, .bloom = { 0, 0, NULL } };
     cs165_log(stderr, "clustered = %d\n", col.clustered);
     enum index_type idx_type = rec->idx_type - '0';
     switch(idx_type) {
@@ -480,10 +497,61 @@ void restore_col_data(struct column *col) {
     fileunmap(data, sz);
 }
 
+/* a database persisted without zone maps gets them rebuilt */
+static
+void restore_zones(struct column *col) {
+    char *tname = col->table->name;
+    char buf[PATHLEN];
+    char *path = vbsnprintf(buf, sizeof buf, "%s/%s.%s.zones.bin", DBPATH, tname, col->name);
+    size_t nzones = (col->data.sz + ZONE_SIZE - 1) / ZONE_SIZE;
+
+    struct stat st;
+    if (stat(path, &st) == 0 && (size_t) st.st_size == nzones * sizeof (struct zone)) {
+	char *data;
+	off_t sz = filemap(path, &data, PROT_READ);
+	col->zones.zones = malloc(sz);
+	assert(col->zones.zones);
+	memcpy(col->zones.zones, data, sz);
+	col->zones.nzones = col->zones.capacity = nzones;
+	fileunmap(data, sz);
+    } else {
+	zonemap_build(&col->zones, col->data.vals, col->data.sz);
+    }
+    if (path != buf) free(path);
+}
+
+/* the filters are optional: a column persisted without them has none */
+static
+void restore_bloom(struct column *col) {
+    char *tname = col->table->name;
+    char buf[PATHLEN];
+    char *path = vbsnprintf(buf, sizeof buf, "%s/%s.%s.bloom.bin", DBPATH, tname, col->name);
+    size_t nzones = (col->data.sz + ZONE_SIZE - 1) / ZONE_SIZE;
+    size_t fsz = nzones * BLOOM_ZONE_WORDS * sizeof (uint64_t);
+
+    struct stat st;
+    if (nzones > 0 && stat(path, &st) == 0 && (size_t) st.st_size == fsz) {
+	char *data;
+	off_t sz = filemap(path, &data, PROT_READ);
+	col->bloom.words = malloc(sz);
+	assert(col->bloom.words);
+	memcpy(col->bloom.words, data, sz);
+	col->bloom.nzones = col->bloom.capacity = nzones;
+	fileunmap(data, sz);
+    }
+    if (path != buf) free(path);
+}
+
+/* readers share the database, so two queries may want the same column */
+static pthread_mutex_t load_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void load_column(struct column *col) {
-    if (col->status == INMEMORY || col->status == MODIFIED) return;
+    pthread_mutex_lock(&load_lock);
+    if (col->status == INMEMORY || col->status == MODIFIED) goto loaded;
 
     restore_col_data(col);
+    restore_zones(col);
+    restore_bloom(col);
     if (col->index) {
 	switch(col->index->type) {
 	    case SORTED: restore_sindex(col); break;
@@ -491,6 +559,9 @@ void load_column(struct column *col) {
 	    case IDX_INVALID: assert(false);
 	}
     }
+
+loaded:
+    pthread_mutex_unlock(&load_lock);
 }
 
 /* eager loading: isn't used at the moment */
@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "tpool.h"
+#include "utils.h"
+
+#define DEFAULT_JOBS_CAPACITY 64
+
+struct job {
+    tpool_fn fn;
+    void *arg;
+};
+
+struct tpool {
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+    bool stopping;
+
+    /* ring buffer of pending jobs, same layout as queue.c */
+    size_t sz;
+    size_t capacity;
+    size_t first;
+    size_t last;
+    struct job *jobs;
+
+    size_t nthreads;
+    pthread_t *threads;
+};
+
+size_t num_cores(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1) ? 1 : (size_t) n;
+}
+
+static inline
+void resize(struct tpool *tp, size_t new_capacity) {
+    struct job *js = malloc(new_capacity * sizeof *js);
+    assert(js);
+
+    for (size_t j = 0; j < tp->sz; j++)
+	js[j] = tp->jobs[(tp->first + j) % tp->capacity];
+
+    free(tp->jobs);
+    tp->jobs = js;
+    tp->capacity = new_capacity;
+    tp->first = 0;
+    tp->last = tp->sz;
+}
+
+static
+void *worker(void *arg) {
+    struct tpool *tp = arg;
+
+    pthread_mutex_lock(&tp->lock);
+    for (;;) {
+	while (tp->sz == 0 && !tp->stopping)
+	    pthread_cond_wait(&tp->nonempty, &tp->lock);
+
+	if (tp->sz == 0) break;	// stopping and drained
+
+	struct job job = tp->jobs[tp->first++];
+	if (tp->first == tp->capacity) tp->first = 0;
+	tp->sz--;
+
+	pthread_mutex_unlock(&tp->lock);
+	job.fn(job.arg);
+	pthread_mutex_lock(&tp->lock);
+    }
+    pthread_mutex_unlock(&tp->lock);
+
+    return NULL;
+}
+
+struct tpool *tpool_create(size_t nthreads) {
+    struct tpool *tp = malloc(sizeof *tp);
+    if (tp == NULL) goto malloc_failed;
+
+    tp->nthreads = (nthreads < 1) ? 1 : nthreads;
+    tp->threads = malloc(tp->nthreads * sizeof *tp->threads);
+    if (tp->threads == NULL) goto threads_failed;
+
+    tp->capacity = DEFAULT_JOBS_CAPACITY;
+    tp->jobs = malloc(tp->capacity * sizeof *tp->jobs);
+    if (tp->jobs == NULL) goto jobs_failed;
+
+    tp->sz = tp->first = tp->last = 0;
+    tp->stopping = false;
+    pthread_mutex_init(&tp->lock, NULL);
+    pthread_cond_init(&tp->nonempty, NULL);
+
+    for (size_t j = 0; j < tp->nthreads; j++) {
+	if (pthread_create(&tp->threads[j], NULL, worker, tp) != 0) {
+	    log_err("tpool: failed to start worker %zu\n", j);
+	    tp->nthreads = j;
+	    break;
+	}
+    }
+
+    if (tp->nthreads == 0) {
+	tpool_destroy(tp);
+	return NULL;
+    }
+
+    return tp;
+
+jobs_failed:
+    free(tp->threads);
+threads_failed:
+    free(tp);
+malloc_failed:
+    return NULL;
+}
+
+/* lets the workers drain everything that was submitted, then joins them */
+void tpool_destroy(struct tpool *tp) {
+    pthread_mutex_lock(&tp->lock);
+    tp->stopping = true;
+    pthread_cond_broadcast(&tp->nonempty);
+    pthread_mutex_unlock(&tp->lock);
+
+    for (size_t j = 0; j < tp->nthreads; j++)
+	pthread_join(tp->threads[j], NULL);
+
+    pthread_cond_destroy(&tp->nonempty);
+    pthread_mutex_destroy(&tp->lock);
+    free(tp->jobs);
+    free(tp->threads);
+    free(tp);
+}
+
+void tpool_submit(struct tpool *tp, tpool_fn fn, void *arg) {
+    pthread_mutex_lock(&tp->lock);
+    assert(!tp->stopping);
+
+    if (tp->sz == tp->capacity) resize(tp, tp->capacity * 2);
+    struct job job = { fn, arg };
+    tp->jobs[tp->last++] = job;
+    if (tp->last == tp->capacity) tp->last = 0;
+    tp->sz++;
+
+    pthread_cond_signal(&tp->nonempty);
+    pthread_mutex_unlock(&tp->lock);
+}
+
+size_t tpool_size(struct tpool *tp) {
+    return tp->nthreads;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/*
+ * A group of tasks of one tpool_run() call. Runners claim task indices until
+ * none are left, the caller being one of them, so a group always completes
+ * even when every pool thread is busy elsewhere.
+ */
+struct tgroup {
+    tpool_fn fn;
+    char *tasks;
+    size_t n;
+    size_t tasksz;
+
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    size_t next;	// next unclaimed task
+    size_t done;	// completed tasks
+    size_t runners;	// submitted runners that have not returned yet
+};
+
+static
+void run_tasks(struct tgroup *g) {
+    pthread_mutex_lock(&g->lock);
+    while (g->next < g->n) {
+	size_t j = g->next++;
+	pthread_mutex_unlock(&g->lock);
+	g->fn(g->tasks + j * g->tasksz);
+	pthread_mutex_lock(&g->lock);
+	g->done++;
+    }
+    pthread_mutex_unlock(&g->lock);
+}
+
+static
+void runner(void *arg) {
+    struct tgroup *g = arg;
+    run_tasks(g);
+
+    pthread_mutex_lock(&g->lock);
+    g->runners--;
+    pthread_cond_signal(&g->finished);
+    pthread_mutex_unlock(&g->lock);
+}
+
+/* calls fn on each of the |n| elements of |tasks| and waits for all of them */
+void tpool_run(struct tpool *tp, tpool_fn fn, void *tasks, size_t n, size_t tasksz) {
+    if (n == 0) return;
+
+    struct tgroup g = { .fn = fn, .tasks = tasks, .n = n, .tasksz = tasksz,
+			.next = 0, .done = 0, .runners = 0 };
+
+    size_t helpers = (tp == NULL) ? 0 : tp->nthreads;
+    if (helpers > n - 1) helpers = n - 1;
+
+    pthread_mutex_init(&g.lock, NULL);
+    pthread_cond_init(&g.finished, NULL);
+
+    g.runners = helpers;
+    for (size_t j = 0; j < helpers; j++)
+	tpool_submit(tp, runner, &g);
+
+    run_tasks(&g);
+
+    pthread_mutex_lock(&g.lock);
+    while (g.done < g.n || g.runners > 0)
+	pthread_cond_wait(&g.finished, &g.lock);
+    pthread_mutex_unlock(&g.lock);
+
+    pthread_cond_destroy(&g.finished);
+    pthread_mutex_destroy(&g.lock);
+}
+
+/*
+ * The number of slices to split |n| items into for tpool_run(): one per
+ * thread of |tp| and one for the caller. Inputs of fewer than |min| items
+ * make a single slice, run by the calling thread alone, as handing them to
+ * the pool costs more than it saves.
+ */
+size_t tpool_tasks(struct tpool *tp, size_t n, size_t min) {
+    return (tp && n >= min) ? tpool_size(tp) + 1 : 1;
+}
+
+/* the offset of slice |t| of |n| items split in |nt| and its length in |*len| */
+size_t tpool_slice(size_t n, size_t nt, size_t t, size_t *len) {
+    size_t per = (n + nt - 1) / nt;
+    size_t off = (t * per < n) ? t * per : n;
+    *len = (n - off < per) ? n - off : per;
+    return off;
+}
+
+static struct tpool *exec;
+static pthread_once_t exec_once = PTHREAD_ONCE_INIT;
+
+static
+void exec_init(void) {
+    size_t cores = num_cores();
+    if (cores > 1) exec = tpool_create(cores - 1);
+}
+
+/*
+ * Pool for intra-query parallelism, separate from the pool serving clients.
+ * NULL on a single core; tpool_run() then runs everything in the caller.
+ */
+struct tpool *exec_pool(void) {
+    pthread_once(&exec_once, exec_init);
+    return exec;
+}
@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "zonemap.h"
+
+void zonemap_init(struct zonemap *zm) {
+    zm->nzones = 0;
+    zm->capacity = 0;
+    zm->zones = NULL;
+}
+
+void zonemap_free(struct zonemap *zm) {
+    free(zm->zones);
+    zonemap_init(zm);
+}
+
+static
+void zonemap_reserve(struct zonemap *zm, size_t nzones) {
+    if (nzones <= zm->capacity) return;
+    size_t capacity = (zm->capacity) ? zm->capacity : 8;
+    while (capacity < nzones) capacity *= 2;
+    zm->zones = realloc(zm->zones, capacity * sizeof *zm->zones);
+    assert(zm->zones);
+    zm->capacity = capacity;
+}
+
+/* recomputes the zones of vals[first * ZONE_SIZE, sz) */
+static
+void zonemap_rebuild(struct zonemap *zm, const int *vals, size_t sz, size_t first) {
+    zm->nzones = (sz + ZONE_SIZE - 1) / ZONE_SIZE;
+    zonemap_reserve(zm, zm->nzones);
+    for (size_t z = first; z < zm->nzones; z++) {
+	size_t end = (z + 1) * ZONE_SIZE < sz ? (z + 1) * ZONE_SIZE : sz;
+	int min = vals[z * ZONE_SIZE], max = min;
+	for (size_t j = z * ZONE_SIZE + 1; j < end; j++) {
+	    min = (vals[j] < min) ? vals[j] : min;
+	    max = (vals[j] > max) ? vals[j] : max;
+	}
+	zm->zones[z].min = min;
+	zm->zones[z].max = max;
+    }
+}
+
+void zonemap_build(struct zonemap *zm, const int *vals, size_t sz) {
+    zonemap_rebuild(zm, vals, sz, 0);
+}
+
+/*
+ * The column |vals| of |sz| values had vals[pos] inserted. An append
+ * extends the last zone; an insert in the middle shifts every later value,
+ * so the zones from |pos| on are recomputed.
+ */
+void zonemap_insert(struct zonemap *zm, const int *vals, size_t sz, size_t pos) {
+    size_t z = pos / ZONE_SIZE;
+    if (pos + 1 < sz || z > zm->nzones) {
+	zonemap_rebuild(zm, vals, sz, (z < zm->nzones) ? z : zm->nzones);
+	return;
+    }
+
+    if (z == zm->nzones) {
+	zonemap_reserve(zm, z + 1);
+	zm->zones[z].min = zm->zones[z].max = vals[pos];
+	zm->nzones++;
+	return;
+    }
+    zonemap_update(zm, pos, vals[pos]);
+}
+
+/* the old value may still be the bound: bounds only widen */
+void zonemap_update(struct zonemap *zm, size_t pos, int value) {
+    struct zone *zone = &zm->zones[pos / ZONE_SIZE];
+    if (value < zone->min) zone->min = value;
+    if (value > zone->max) zone->max = value;
+}